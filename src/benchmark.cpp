@@ -0,0 +1,1903 @@
+#include "benchmark.h"
+
+#include "tree_walker.h"
+#include "compiled_tree.h"
+#include "compiled_layout.h"
+#include "tree_ensemble.h"
+#include "bitvector_tree.h"
+#include "tree_batch.h"
+#include "tree_evaluator.h"
+#include "tree_binding.h"
+#include "tree_replica.h"
+#include "tree_pages.h"
+#include "tree_table.h"
+#include "tree_editor.h"
+#include "tree_delta.h"
+#include "tree_memory.h"
+#include "tree_lazy.h"
+#include "louds_tree.h"
+#include "tree_registry.h"
+
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static double bench_seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ------------------------------------------------------------------------
+// tree generation
+// ------------------------------------------------------------------------
+// Writes a tree of decision nodes where every node splits its range into
+// fanout intervals. Leaves are named by their path index.
+static void bench_write_decision(FILE* file, int depth, int fanout, long long lo, long long hi, long long& leaf)
+{
+    long long step = (hi - lo + 1) / fanout;
+    for (int i = 0; i < fanout; ++i)
+    {
+        long long a = lo + i * step;
+        long long b = i == fanout - 1 ? hi : a + step - 1;
+
+        if (depth <= 1)
+        {
+            fprintf(file, "<final value=\"%lld:%lld\" name=\"leaf%lld\"/>\n", a, b, leaf++);
+            continue;
+        }
+
+        fprintf(file, "<decision value=\"%lld:%lld\" name=\"var%d\">\n", a, b, depth - 1);
+        bench_write_decision(file, depth - 1, fanout, 0, 1999999, leaf);
+        fprintf(file, "</decision>\n");
+    }
+}
+
+static int bench_generate_decision_tree(const char* filename, int depth, int fanout)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file) return 0;
+
+    long long leaf = 0;
+    fprintf(file, "<decisiontree>\n<decision name=\"var%d\">\n", depth);
+    bench_write_decision(file, depth, fanout, 0, 1999999, leaf);
+    fprintf(file, "</decision>\n</decisiontree>\n");
+
+    fclose(file);
+    return 1;
+}
+
+// Writes a tree of option nodes with fanout string values per node.
+static void bench_write_option(FILE* file, int depth, int fanout, long long& leaf)
+{
+    for (int i = 0; i < fanout; ++i)
+    {
+        if (depth <= 1)
+        {
+            fprintf(file, "<final value=\"value%d\" name=\"result%lld\"/>\n", i, leaf++ % 100);
+            continue;
+        }
+
+        fprintf(file, "<option value=\"value%d\" name=\"question%d\">\n", i, depth - 1);
+        bench_write_option(file, depth - 1, fanout, leaf);
+        fprintf(file, "</option>\n");
+    }
+}
+
+static int bench_generate_option_tree(const char* filename, int depth, int fanout)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file) return 0;
+
+    long long leaf = 0;
+    fprintf(file, "<decisiontree>\n<option name=\"question%d\">\n", depth);
+    bench_write_option(file, depth, fanout, leaf);
+    fprintf(file, "</option>\n</decisiontree>\n");
+
+    fclose(file);
+    return 1;
+}
+
+// Same shape as bench_generate_decision_tree, but built in memory for trees
+// too large to go through XML.
+static TreeNode bench_build_decision_tree(int depth, int fanout, int64_t lo, int64_t hi, long long& leaf)
+{
+    TreeNode node = { NodeType::DECISION, "var" + std::to_string(depth) };
+
+    int64_t step = (hi - lo + 1) / fanout;
+    node.choices.reserve(fanout);
+    for (int i = 0; i < fanout; ++i)
+    {
+        int64_t a = lo + i * step;
+        int64_t b = i == fanout - 1 ? hi : a + step - 1;
+
+        if (depth <= 1)
+            node.choices.push_back({ NodeType::FINAL, "leaf" + std::to_string(leaf++) });
+        else
+            node.choices.push_back(bench_build_decision_tree(depth - 1, fanout, lo, hi, leaf));
+
+        node.choices.back().value = DecisionExpr{ DecisionOp::BETWEEN, a, b };
+    }
+    return node;
+}
+
+// Random tree over the numeric features f0 .. f<features - 1> with values in
+// [0, 1000), results are the class numbers 0 .. classes - 1.
+static TreeNode bench_build_random_tree(std::mt19937_64& rng, int depth, int features, int classes)
+{
+    if (depth <= 1)
+        return { NodeType::FINAL, std::to_string(rng() % classes) };
+
+    TreeNode node = { NodeType::DECISION, "f" + std::to_string(rng() % features) };
+
+    int fanout = 2 + (int)(rng() % 3);
+    int64_t lo = 0;
+    for (int i = 0; i < fanout; ++i)
+    {
+        int64_t hi = i == fanout - 1 ? 999 : lo + (int64_t)(rng() % (1000 - lo - (fanout - i) + 1));
+
+        TreeNode choice = bench_build_random_tree(rng, depth - 1, features, classes);
+        choice.value = DecisionExpr{ DecisionOp::BETWEEN, lo, hi };
+        node.choices.push_back(choice);
+
+        lo = hi + 1;
+    }
+    return node;
+}
+
+static size_t bench_count_nodes(const TreeNode& node)
+{
+    size_t count = 1;
+    for (const auto& choice : node.choices)
+        count += bench_count_nodes(choice);
+    return count;
+}
+
+// random records for a compiled tree, option features get one of the symbols
+// "value0" .. "value<fanout - 1>", decision features a value in [lo, hi]
+static std::vector<int64_t> bench_records(const SymbolPool& symbols, const FeatureSet& features, size_t count, int fanout, int64_t lo, int64_t hi)
+{
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> number(lo, hi);
+    std::uniform_int_distribution<int> option(0, fanout - 1);
+
+    size_t width = features.symbols.size();
+    std::vector<int64_t> records(count * width);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        std::string value = "value" + std::to_string(option(rng));
+        uint32_t symbol = symbol_pool_find(symbols, value);
+        records[i] = symbol != SYMBOL_NONE ? symbol : number(rng);
+    }
+    return records;
+}
+
+// walk the TreeNode tree with a compiled record, to check compiled results
+static const TreeNode* bench_walk_record(const TreeNode* node, const SymbolPool& symbols, const FeatureSet& features, const int64_t* record)
+{
+    while (node && node->type != NodeType::FINAL)
+    {
+        int64_t value = record[feature_set_find(features, symbol_pool_find(symbols, node->name))];
+        if (node->type == NodeType::OPTION)
+            node = decision_tree_step(node, symbol_pool_get(symbols, (uint32_t)value));
+        else
+            node = decision_tree_step(node, value);
+    }
+    return node;
+}
+
+// ------------------------------------------------------------------------
+// load
+// ------------------------------------------------------------------------
+static void bench_load()
+{
+    const char* filename = "bench_load.xml";
+    if (!bench_generate_decision_tree(filename, 6, 10)) return;
+
+    const int runs = 5;
+    double best = 0.0;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        TreeWalker walker;
+        tree_walker_load(walker, filename);
+
+        double seconds = bench_seconds(start);
+        if (i == 0 || seconds < best) best = seconds;
+    }
+
+    printf("load: 1111110 nodes in %.3fs (best of %d)\n", best, runs);
+}
+
+// ------------------------------------------------------------------------
+// memory footprint
+// ------------------------------------------------------------------------
+static void bench_footprint_tree(const char* label, const char* filename, int fanout)
+{
+    TreeWalker walker;
+    if (!tree_walker_load(walker, filename)) return;
+
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    if (!compiled_tree_build(tree, walker.root, symbols, features)) return;
+
+    size_t nodes = bench_count_nodes(walker.root);
+    size_t tree_bytes = tree_node_bytes(walker.root);
+    size_t compiled_bytes = compiled_tree_bytes(tree);
+
+    printf("footprint (%s, %zu nodes):\n", label, nodes);
+    printf("  TreeNode:     %10zu bytes (%5.1f per node, sizeof %zu)\n", tree_bytes, (double)tree_bytes / nodes, sizeof(TreeNode));
+    printf("  CompiledTree: %10zu bytes (%5.1f per node, %zu hot)\n", compiled_bytes, (double)compiled_bytes / nodes, sizeof(PackedNode));
+
+    // both representations have to agree
+    const size_t count = 100000;
+    auto records = bench_records(symbols, features, count, fanout, 0, 1999999);
+    size_t width = features.symbols.size();
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int64_t* record = records.data() + i * width;
+        const TreeNode* expected = bench_walk_record(&walker.root, symbols, features, record);
+        uint32_t node = compiled_tree_eval(tree, record);
+
+        std::string_view name = node != COMPILED_NONE ? symbol_pool_get(symbols, tree.names[node]) : "";
+        if ((expected == nullptr) != (node == COMPILED_NONE) || (expected && expected->name != name))
+            mismatches++;
+    }
+    printf("  %zu mismatches in %zu records\n", mismatches, count);
+}
+
+static void bench_footprint()
+{
+    if (bench_generate_decision_tree("bench_decision.xml", 6, 10))
+        bench_footprint_tree("decision", "bench_decision.xml", 10);
+
+    if (bench_generate_option_tree("bench_option.xml", 6, 10))
+        bench_footprint_tree("option", "bench_option.xml", 10);
+}
+
+// ------------------------------------------------------------------------
+// interleaved traversal
+// ------------------------------------------------------------------------
+static void bench_interleaved()
+{
+    const int depth = 7;
+    const int fanout = 10;
+    const int64_t hi = 1999999;
+
+    long long leaf = 0;
+    TreeNode root = bench_build_decision_tree(depth, fanout, 0, hi, leaf);
+
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    if (!compiled_tree_build(tree, root, symbols, features)) return;
+
+    const size_t count = 2000000;
+    auto records = bench_records(symbols, features, count, fanout, 0, hi);
+    size_t width = features.symbols.size();
+
+    printf("interleaved traversal (%zu nodes, %.0f MB compiled, %zu records):\n",
+        tree.nodes.size(), compiled_tree_bytes(tree) / 1e6, count);
+
+    // baseline: one record after another on the TreeNode tree, the features
+    // of the generated tree are numbered by depth
+    size_t reached = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int64_t* record = records.data() + i * width;
+        const TreeNode* node = &root;
+        for (int level = 0; node && node->type != NodeType::FINAL; ++level)
+            node = decision_tree_step(node, record[level]);
+        reached += node != nullptr;
+    }
+    double seconds = bench_seconds(start);
+    printf("  decision_tree_step:  %7.1f ns/record (%zu reached)\n", seconds * 1e9 / count, reached);
+
+    std::vector<uint32_t> expected(count);
+    std::vector<uint32_t> results(count);
+    for (size_t group : { 1, 8, 16, 32 })
+    {
+        start = std::chrono::steady_clock::now();
+        compiled_tree_eval_batch(tree, records.data(), width, count, results.data(), group);
+        seconds = bench_seconds(start);
+
+        if (group == 1) expected = results;
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i)
+            mismatches += results[i] != expected[i];
+
+        printf("  compiled, group %2zu: %7.1f ns/record (%zu mismatches)\n", group, seconds * 1e9 / count, mismatches);
+    }
+}
+
+// ------------------------------------------------------------------------
+// ensemble
+// ------------------------------------------------------------------------
+static void bench_ensemble_run(size_t tree_count, size_t record_count)
+{
+    const int features = 32;
+    const int classes = 5;
+
+    std::mt19937_64 rng(7);
+    std::vector<TreeNode> roots;
+    TreeEnsemble ensemble;
+    for (size_t i = 0; i < tree_count; ++i)
+    {
+        roots.push_back(bench_build_random_tree(rng, 8, features, classes));
+        tree_ensemble_add(ensemble, roots.back(), 1.0);
+    }
+
+    // inputs as they come in: one answer string per feature name
+    std::vector<std::string> names(features);
+    std::vector<std::vector<std::string>> inputs(record_count, std::vector<std::string>(features));
+    for (int f = 0; f < features; ++f)
+        names[f] = "f" + std::to_string(f);
+    for (auto& input : inputs)
+        for (auto& answer : input)
+            answer = std::to_string(rng() % 1000);
+
+    // baseline: every tree looks up and parses the answers it needs on its own
+    size_t agree = 0;
+    std::vector<uint32_t> baseline(record_count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < record_count; ++r)
+    {
+        std::unordered_map<std::string, std::string> answers;
+        for (int f = 0; f < features; ++f)
+            answers.emplace(names[f], inputs[r][f]);
+
+        std::map<std::string, int> votes;
+        for (const auto& root : roots)
+        {
+            const TreeNode* node = &root;
+            while (node && node->type == NodeType::DECISION)
+            {
+                const std::string& answer = answers[node->name];
+                int64_t value = 0;
+                std::from_chars(answer.data(), answer.data() + answer.size(), value);
+                node = decision_tree_step(node, value);
+            }
+            if (node) votes[node->name]++;
+        }
+
+        // same tie break as the ensemble: the class seen first while loading
+        int best = 0;
+        uint32_t best_class = SYMBOL_NONE;
+        for (const auto& vote : votes)
+        {
+            uint32_t symbol = symbol_pool_find(ensemble.symbols, vote.first);
+            uint32_t vote_class = ensemble.classes[symbol];
+            if (vote.second > best || (vote.second == best && vote_class < best_class))
+            {
+                best = vote.second;
+                best_class = vote_class;
+                baseline[r] = symbol;
+            }
+        }
+    }
+    double seconds_baseline = bench_seconds(start);
+
+    // ensemble: decode once, then evaluate all trees on the shared record
+    size_t width = ensemble.features.symbols.size();
+    std::vector<int64_t> records(record_count * width);
+    std::vector<EnsembleVote> votes(record_count);
+    std::vector<std::string_view> views(features);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<std::string_view> name_views(names.begin(), names.end());
+    for (size_t r = 0; r < record_count; ++r)
+    {
+        for (int f = 0; f < features; ++f)
+            views[f] = inputs[r][f];
+        tree_ensemble_decode(ensemble, name_views.data(), views.data(), features, records.data() + r * width);
+    }
+    double seconds_decode = bench_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    tree_ensemble_vote(ensemble, records.data(), record_count, votes.data(), std::thread::hardware_concurrency());
+    double seconds_vote = bench_seconds(start);
+
+    for (size_t r = 0; r < record_count; ++r)
+        agree += votes[r].result == baseline[r];
+
+    double evals = (double)record_count * tree_count;
+    printf("  %4zu trees: independent %6.1f ns/tree, ensemble %6.1f ns/tree (decode %.1f us/record), %zu/%zu votes agree\n",
+        tree_count, seconds_baseline * 1e9 / evals, (seconds_decode + seconds_vote) * 1e9 / evals,
+        seconds_decode * 1e6 / record_count, agree, record_count);
+}
+
+static void bench_ensemble()
+{
+    printf("ensemble (depth 8, %u threads):\n", std::thread::hardware_concurrency());
+    bench_ensemble_run(100, 20000);
+    bench_ensemble_run(1000, 2000);
+}
+
+// ------------------------------------------------------------------------
+// bitvector
+// ------------------------------------------------------------------------
+static void bench_bitvector_run(int depth, size_t count)
+{
+    const int features = 16;
+
+    std::mt19937_64 rng(11);
+    TreeNode root = bench_build_random_tree(rng, depth, features, 5);
+
+    SymbolPool symbols;
+    FeatureSet feature_set;
+    CompiledTree tree;
+    BitvectorTree bits;
+    if (!compiled_tree_build(tree, root, symbols, feature_set)) return;
+    if (!bitvector_tree_build(bits, tree, feature_set.symbols.size())) return;
+
+    auto records = bench_records(symbols, feature_set, count, 1, 0, 999);
+    size_t width = feature_set.symbols.size();
+
+    size_t reached = 0;
+    std::vector<const TreeNode*> expected(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        expected[i] = bench_walk_record(&root, symbols, feature_set, records.data() + i * width);
+        reached += expected[i] != nullptr;
+    }
+    double seconds_walk = bench_seconds(start);
+
+    std::vector<uint32_t> compiled(count);
+    start = std::chrono::steady_clock::now();
+    compiled_tree_eval_batch(tree, records.data(), width, count, compiled.data(), 1);
+    double seconds_compiled = bench_seconds(start);
+
+    std::vector<uint32_t> results(count);
+    start = std::chrono::steady_clock::now();
+    bitvector_tree_eval_batch(bits, records.data(), width, count, results.data());
+    double seconds_bits = bench_seconds(start);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        bool found = results[i] != COMPILED_NONE;
+        mismatches += results[i] != compiled[i] || found != (expected[i] != nullptr)
+            || (found && expected[i]->name != symbol_pool_get(symbols, tree.names[results[i]]));
+    }
+
+    printf("  depth %d (%5zu leaves, %5zu thresholds): walk %6.1f, compiled %6.1f, bitvector %6.1f ns/record (%zu reached, %zu mismatches)\n",
+        depth, bits.leaves.size(), bits.entries.size(), seconds_walk * 1e9 / count, seconds_compiled * 1e9 / count,
+        seconds_bits * 1e9 / count, reached, mismatches);
+}
+
+static void bench_bitvector()
+{
+    printf("bitvector evaluation (16 features):\n");
+    bench_bitvector_run(3, 1000000);
+    bench_bitvector_run(4, 1000000);
+    bench_bitvector_run(6, 1000000);
+    bench_bitvector_run(8, 200000);
+}
+
+// ------------------------------------------------------------------------
+// columnar batch
+// ------------------------------------------------------------------------
+static void bench_batch()
+{
+    const int features = 16;
+    const size_t count = 1000000;
+
+    std::mt19937_64 rng(13);
+    TreeNode root = bench_build_random_tree(rng, 10, features, 5);
+
+    std::vector<std::string> names(features);
+    std::vector<std::vector<int64_t>> values(features, std::vector<int64_t>(count));
+    TreeColumns columns = { count };
+    for (int f = 0; f < features; ++f)
+    {
+        names[f] = "f" + std::to_string(f);
+        for (auto& value : values[f])
+            value = rng() % 1000;
+        columns.numbers[names[f]] = values[f].data();
+    }
+
+    printf("columnar batch (%zu nodes, %zu rows):\n", bench_count_nodes(root), count);
+
+    std::vector<const TreeNode*> expected(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < count; ++r)
+    {
+        const TreeNode* node = &root;
+        while (node && node->type == NodeType::DECISION)
+            node = decision_tree_step(node, columns.numbers.find(node->name)->second[r]);
+        expected[r] = node;
+    }
+    double seconds = bench_seconds(start);
+    printf("  decision_tree_step: %6.1f ns/row\n", seconds * 1e9 / count);
+
+    for (size_t chunk : { (size_t)1024, (size_t)16384, count })
+    {
+        std::vector<const TreeNode*> results(count);
+        start = std::chrono::steady_clock::now();
+        for (size_t first = 0; first < count; first += chunk)
+        {
+            // a chunk is a view on the same columns
+            TreeColumns part = { std::min(chunk, count - first) };
+            for (int f = 0; f < features; ++f)
+                part.numbers[names[f]] = values[f].data() + first;
+            tree_batch_eval(root, part, results.data() + first);
+        }
+        seconds = bench_seconds(start);
+
+        size_t mismatches = 0;
+        for (size_t r = 0; r < count; ++r)
+            mismatches += results[r] != expected[r];
+        printf("  batch, chunk %7zu: %6.1f ns/row (%zu mismatches)\n", chunk, seconds * 1e9 / count, mismatches);
+    }
+}
+
+// ------------------------------------------------------------------------
+// lazy evaluation
+// ------------------------------------------------------------------------
+// provider answering every fetch after a fixed latency, from its own thread
+struct BenchDelayLine
+{
+    struct Pending
+    {
+        std::chrono::steady_clock::time_point due;
+        TreeEvaluation* evaluation;
+        std::string answer;
+
+        bool operator>(const Pending& other) const { return due > other.due; }
+    };
+
+    std::chrono::microseconds latency;
+    std::atomic<size_t> fetches;
+
+    std::mutex mutex;
+    std::condition_variable signal;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> pending;
+    bool stopping;
+};
+
+struct BenchLazyWalk
+{
+    const int64_t* record;
+    const TreeNode* result;
+};
+
+// variables are named f<index> into the record of the walk
+static void bench_delay_fetch(TreeEvaluation* evaluation, const std::string& name, void* context)
+{
+    BenchDelayLine* line = (BenchDelayLine*)context;
+    const int64_t* record = ((BenchLazyWalk*)evaluation->user)->record;
+    std::string answer = std::to_string(record[atoi(name.c_str() + 1)]);
+
+    line->fetches++;
+    std::lock_guard<std::mutex> lock(line->mutex);
+    line->pending.push({ std::chrono::steady_clock::now() + line->latency, evaluation, answer });
+    line->signal.notify_one();
+}
+
+static void bench_delay_run(BenchDelayLine* line)
+{
+    std::unique_lock<std::mutex> lock(line->mutex);
+    while (!line->stopping)
+    {
+        if (line->pending.empty())
+        {
+            line->signal.wait(lock);
+            continue;
+        }
+
+        auto due = line->pending.top().due;
+        if (std::chrono::steady_clock::now() < due)
+        {
+            line->signal.wait_until(lock, due);
+            continue;
+        }
+
+        BenchDelayLine::Pending next = line->pending.top();
+        line->pending.pop();
+
+        lock.unlock();
+        tree_evaluation_resume(next.evaluation, next.answer);
+        lock.lock();
+    }
+}
+
+static void bench_lazy_done(TreeEvaluation* evaluation, const TreeNode* result, void* user)
+{
+    ((BenchLazyWalk*)user)->result = result;
+}
+
+static void bench_lazy()
+{
+    const int features = 16;
+    const size_t count = 20000;
+    const size_t blocking = 200;
+    const std::chrono::microseconds latency(200);
+
+    std::mt19937_64 rng(17);
+    TreeNode root = bench_build_random_tree(rng, 8, features, 5);
+
+    std::vector<int64_t> records(count * features);
+    for (auto& value : records)
+        value = rng() % 1000;
+
+    printf("lazy evaluation (%d features, %lld us per fetch):\n", features, (long long)latency.count());
+
+    // baseline: one walk after another, blocking on every fetch
+    size_t fetches = 0;
+    std::vector<const TreeNode*> expected(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < count; ++r)
+    {
+        const int64_t* record = records.data() + r * features;
+        const TreeNode* node = &root;
+        while (node && node->type == NodeType::DECISION)
+        {
+            if (r < blocking)
+            {
+                std::this_thread::sleep_for(latency);
+                fetches++;
+            }
+            node = decision_tree_step(node, record[atoi(node->name.c_str() + 1)]);
+        }
+        expected[r] = node;
+    }
+    double seconds = bench_seconds(start);
+    printf("  blocking:  %8.1f us/walk (%.1f fetches/walk, first %zu walks)\n",
+        seconds * 1e6 / blocking, (double)fetches / blocking, blocking);
+
+    BenchDelayLine line;
+    line.latency = latency;
+    line.fetches = 0;
+    line.stopping = false;
+    std::thread delay(bench_delay_run, &line);
+
+    for (size_t threads : { 1, 2 })
+    {
+        line.fetches = 0;
+        std::vector<TreeEvaluation> evaluations(count);
+        std::vector<BenchLazyWalk> walks(count);
+
+        TreeEvaluator evaluator;
+        tree_evaluator_start(evaluator, threads, bench_delay_fetch, &line);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < count; ++r)
+        {
+            walks[r] = { records.data() + r * features, nullptr };
+            tree_evaluation_start(evaluator, &evaluations[r], root, bench_lazy_done, &walks[r]);
+        }
+        tree_evaluator_stop(evaluator);
+        seconds = bench_seconds(start);
+
+        size_t mismatches = 0;
+        for (size_t r = 0; r < count; ++r)
+            mismatches += walks[r].result != expected[r];
+
+        printf("  lazy, %zu threads: %6.2f us/walk (%.1f fetches/walk, %zu walks, %zu mismatches)\n",
+            threads, seconds * 1e6 / count, (double)line.fetches / count, count, mismatches);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(line.mutex);
+        line.stopping = true;
+        line.signal.notify_one();
+    }
+    delay.join();
+}
+
+// ------------------------------------------------------------------------
+// typed binding
+// ------------------------------------------------------------------------
+enum class BenchWeather { Sunny, Cloudy, Rainy, Foggy };
+enum class BenchHungry { No, Yes };
+
+struct BenchTrip
+{
+    BenchWeather weather;
+    int time;
+    BenchHungry hungry;
+};
+
+static void bench_binding()
+{
+    TreeWalker walker;
+    if (!tree_walker_load(walker, "res/tree.xml")) return;
+
+    TreeField<BenchTrip> fields[] = {
+        tree_field<&BenchTrip::weather>("weather", {
+            { "sunny", BenchWeather::Sunny }, { "cloudy", BenchWeather::Cloudy },
+            { "rainy", BenchWeather::Rainy }, { "foggy", BenchWeather::Foggy } }),
+        tree_field<&BenchTrip::time>("time"),
+        tree_field<&BenchTrip::hungry>("hungry", { { "no", BenchHungry::No }, { "yes", BenchHungry::Yes } }),
+    };
+
+    TreeBinding<BenchTrip> binding;
+    if (!tree_binding_build(binding, walker.root, fields, 3)) return;
+
+    const char* weathers[] = { "sunny", "cloudy", "rainy", "foggy" };
+    const char* hungers[] = { "no", "yes" };
+
+    const size_t count = 2000000;
+    std::mt19937_64 rng(19);
+    std::vector<BenchTrip> trips(count);
+    std::vector<std::string> times(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        trips[i] = { (BenchWeather)(rng() % 4), (int)(rng() % 100) - 10, (BenchHungry)(rng() % 2) };
+        times[i] = std::to_string(trips[i].time);
+    }
+
+    printf("typed binding (res/tree.xml, %zu trips):\n", count);
+
+    // baseline: answers as strings, parsed on every step
+    std::vector<const TreeNode*> expected(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const TreeNode* node = &walker.root;
+        while (node && node->type != NodeType::FINAL)
+        {
+            std::string_view answer;
+            if (node->name == "weather")    answer = weathers[(int)trips[i].weather];
+            else if (node->name == "time")  answer = times[i];
+            else                            answer = hungers[(int)trips[i].hungry];
+            node = decision_tree_walk(node, &answer, 1);
+        }
+        expected[i] = node;
+    }
+    double seconds = bench_seconds(start);
+    printf("  string answers: %6.1f ns/trip\n", seconds * 1e9 / count);
+
+    size_t mismatches = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string_view name = tree_binding_name(binding, tree_binding_eval(binding, trips[i]));
+        mismatches += expected[i] ? name != expected[i]->name : !name.empty();
+    }
+    seconds = bench_seconds(start);
+    printf("  bound fields:   %6.1f ns/trip (%zu mismatches)\n", seconds * 1e9 / count, mismatches);
+}
+
+// ------------------------------------------------------------------------
+// numa replication
+// ------------------------------------------------------------------------
+struct BenchReplicaWork
+{
+    const int64_t* records;
+    size_t width;
+    size_t count;
+    size_t threads;
+    std::vector<uint32_t> results;
+};
+
+static void bench_replica_work(const TreeReplica& replica, size_t worker, void* user)
+{
+    BenchReplicaWork* work = (BenchReplicaWork*)user;
+
+    size_t chunk = (work->count + work->threads - 1) / work->threads;
+    size_t first = std::min(work->count, worker * chunk);
+    size_t last = std::min(work->count, first + chunk);
+
+    compiled_tree_eval_batch(replica.tree, work->records + first * work->width, work->width,
+        last - first, work->results.data() + first, 8);
+}
+
+static void bench_replica()
+{
+    const int depth = 6;
+    const int fanout = 10;
+    const int64_t hi = 1999999;
+
+    long long leaf = 0;
+    TreeWalker walker;
+    walker.root = bench_build_decision_tree(depth, fanout, 0, hi, leaf);
+
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    if (!compiled_tree_build(tree, walker.root, symbols, features)) return;
+
+    const size_t count = 2000000;
+    auto records = bench_records(symbols, features, count, fanout, 0, hi);
+
+    size_t nodes = numa_nodes().size();
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    printf("numa replication (%zu nodes, %zu cpus, %.0f MB compiled, %zu records):\n",
+        nodes, cpus, compiled_tree_bytes(tree) / 1e6, count);
+
+    for (bool replicate : { false, true })
+    {
+        TreeReplicas replicas;
+        tree_replicas_build(replicas, tree, walker, replicate);
+
+        for (size_t threads = 1; threads <= cpus; threads *= 2)
+        {
+            BenchReplicaWork work = { records.data(), features.symbols.size(), count, threads };
+            work.results.resize(count);
+
+            auto start = std::chrono::steady_clock::now();
+            tree_replicas_run(replicas, threads, bench_replica_work, &work);
+            double seconds = bench_seconds(start);
+
+            printf("  %s, %3zu threads: %6.1f M records/s\n",
+                replicate ? "replicated" : "shared    ", threads, count / seconds / 1e6);
+        }
+    }
+}
+
+// ------------------------------------------------------------------------
+// huge pages
+// ------------------------------------------------------------------------
+// dTLB load misses of this thread, -1 where perf events are not available
+#ifdef __linux__
+static int bench_dtlb_open()
+{
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void bench_dtlb_start(int fd)
+{
+    if (fd < 0) return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static long long bench_dtlb_stop(int fd)
+{
+    long long count = -1;
+    if (fd < 0) return count;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+    return count;
+}
+
+static void bench_dtlb_close(int fd)
+{
+    if (fd >= 0) close(fd);
+}
+#else
+static int bench_dtlb_open() { return -1; }
+static void bench_dtlb_start(int fd) {}
+static long long bench_dtlb_stop(int fd) { return -1; }
+static void bench_dtlb_close(int fd) {}
+#endif
+
+static void bench_pages()
+{
+    const int depth = 7;
+    const int fanout = 10;
+    const int64_t hi = 1999999;
+
+    long long leaf = 0;
+    TreeNode root = bench_build_decision_tree(depth, fanout, 0, hi, leaf);
+
+    const size_t count = 2000000;
+    std::vector<int64_t> records;
+    std::vector<uint32_t> expected(count);
+    std::vector<uint32_t> results(count);
+
+    struct
+    {
+        const char* name;
+        TreePageOptions options;
+    } modes[] = {
+        { "default    ", { TreePages::DEFAULT } },
+        { "transparent", { TreePages::TRANSPARENT } },
+        { "hugetlb    ", { TreePages::HUGETLB } },
+        { "thp, locked", { TreePages::TRANSPARENT, true, true } },
+    };
+
+    int dtlb = bench_dtlb_open();
+    for (const auto& mode : modes)
+    {
+        tree_pages_configure(mode.options);
+
+        SymbolPool symbols;
+        FeatureSet features;
+        CompiledTree tree;
+        auto start = std::chrono::steady_clock::now();
+        if (!compiled_tree_build(tree, root, symbols, features)) break;
+        double seconds_build = bench_seconds(start);
+
+        if (records.empty())
+        {
+            records = bench_records(symbols, features, count, fanout, 0, hi);
+            printf("huge pages (%zu nodes, %.0f MB compiled, %zu records):\n", tree.nodes.size(), compiled_tree_bytes(tree) / 1e6, count);
+        }
+
+        bench_dtlb_start(dtlb);
+        start = std::chrono::steady_clock::now();
+        compiled_tree_eval_batch(tree, records.data(), features.symbols.size(), count, results.data(), 1);
+        double seconds = bench_seconds(start);
+        long long misses = bench_dtlb_stop(dtlb);
+
+        if (mode.options.pages == TreePages::DEFAULT) expected = results;
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i)
+            mismatches += results[i] != expected[i];
+
+        printf("  %s: build %5.2f s, %6.1f ns/record, ", mode.name, seconds_build, seconds * 1e9 / count);
+        if (misses >= 0) printf("%5.2f dTLB misses/record", (double)misses / count);
+        else             printf("dTLB misses n/a");
+        printf(" (%zu mismatches)\n", mismatches);
+    }
+    bench_dtlb_close(dtlb);
+
+    tree_pages_configure(TreePageOptions());
+}
+
+// ------------------------------------------------------------------------
+// layouts
+// ------------------------------------------------------------------------
+// most values near lo, so the first choices of every node are taken most
+static std::vector<int64_t> bench_skewed_records(size_t seed, size_t count, size_t width, int64_t hi)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    std::vector<int64_t> records(count * width);
+    for (auto& value : records)
+        value = (int64_t)(std::pow(unit(rng), 6.0) * hi);
+    return records;
+}
+
+static void bench_layout()
+{
+    const int depth = 7;
+    const int fanout = 10;
+    const int64_t hi = 1999999;
+
+    long long leaf = 0;
+    TreeNode root = bench_build_decision_tree(depth, fanout, 0, hi, leaf);
+
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    if (!compiled_tree_build(tree, root, symbols, features)) return;
+    root = TreeNode();
+
+    const size_t count = 2000000;
+    size_t width = features.symbols.size();
+    auto uniform = bench_records(symbols, features, count, fanout, 0, hi);
+    auto skewed = bench_skewed_records(23, count, width, hi);
+    auto sample = bench_skewed_records(29, count / 10, width, hi);
+
+    printf("layouts (%zu nodes, %.0f MB compiled, %zu records, profiled on a skewed sample):\n",
+        tree.nodes.size(), compiled_tree_bytes(tree) / 1e6, count);
+
+    std::vector<uint32_t> expected_uniform(count), expected_skewed(count);
+    std::vector<uint32_t> results(count);
+
+    struct
+    {
+        const char* name;
+        TreeLayout layout;
+    } layouts[] = {
+        { "bfs", TreeLayout::BFS },
+        { "dfs", TreeLayout::DFS },
+        { "veb", TreeLayout::VEB },
+        { "hot", TreeLayout::HOT },
+    };
+
+    for (const auto& layout : layouts)
+    {
+        std::vector<uint64_t> visits;
+        if (layout.layout == TreeLayout::HOT)
+            visits = compiled_tree_profile(tree, sample.data(), width, count / 10);
+        compiled_tree_relayout(tree, layout.layout, visits.data());
+
+        double seconds[2];
+        size_t mismatches = 0;
+        for (int skew = 0; skew < 2; ++skew)
+        {
+            const auto& records = skew ? skewed : uniform;
+            auto& expected = skew ? expected_skewed : expected_uniform;
+
+            auto start = std::chrono::steady_clock::now();
+            compiled_tree_eval_batch(tree, records.data(), width, count, results.data(), 1);
+            seconds[skew] = bench_seconds(start);
+
+            // node ids differ between layouts, the names don't
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t name = results[i] != COMPILED_NONE ? tree.names[results[i]] : SYMBOL_NONE;
+                if (layout.layout == TreeLayout::BFS) expected[i] = name;
+                mismatches += name != expected[i];
+            }
+        }
+
+        printf("  %s: uniform %6.1f ns/record, skewed %6.1f ns/record (%zu mismatches)\n",
+            layout.name, seconds[0] * 1e9 / count, seconds[1] * 1e9 / count, mismatches);
+    }
+}
+
+// ------------------------------------------------------------------------
+// decision table
+// ------------------------------------------------------------------------
+static void bench_table()
+{
+    long long leaf = 0;
+    TreeNode root = bench_build_decision_tree(6, 10, 0, 1999999, leaf);
+
+    FILE* file = tmpfile();
+    if (!file) return;
+
+    TreeTableStats stats;
+    auto start = std::chrono::steady_clock::now();
+    tree_table_export(root, file, TreeTableFormat::BINARY, &stats);
+    double seconds = bench_seconds(start);
+
+    printf("decision table (%zu nodes): %zu rows, %zu pruned, %.1f MB in %.2f s (%.1f M rows/s)\n",
+        bench_count_nodes(root), stats.rows, stats.pruned, ftell(file) / 1e6, seconds, stats.rows / seconds / 1e6);
+    fclose(file);
+}
+
+// random path of at least one step to an existing node, the last step is
+// taken only if the node at the end has choices
+static std::vector<uint32_t> bench_edit_path(std::mt19937_64& rng, const TreeEditNode* node, size_t max_depth)
+{
+    std::vector<uint32_t> path;
+    while (path.size() < max_depth && !node->choices.empty())
+    {
+        uint32_t choice = (uint32_t)(rng() % node->choices.size());
+        path.push_back(choice);
+        node = node->choices[choice].get();
+    }
+    return path;
+}
+
+static void bench_edit()
+{
+    long long leaf = 0;
+    TreeNode root = bench_build_decision_tree(6, 10, 0, 1999999, leaf);
+    long long leaves = leaf;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        SymbolPool symbols;
+        FeatureSet features;
+        CompiledTree tree;
+        compiled_tree_build(tree, root, symbols, features);
+    }
+    double full = bench_seconds(start);
+
+    TreeEditor editor;
+    tree_editor_open(editor, root);
+
+    // a reader keeps walking whatever version is current, pausing so the
+    // edit timings don't depend on how the threads are scheduled
+    std::atomic<bool> editing = true;
+    std::atomic<size_t> walks = 0;
+    std::thread reader([&]()
+    {
+        auto version = tree_editor_acquire(editor);
+        std::vector<int64_t> records;
+        {
+            std::lock_guard<std::mutex> lock(version->symbols->mutex);
+            records = bench_records(version->symbols->pool, *version->features, 1024, 1, 0, 1999999);
+        }
+        size_t width = version->features->symbols.size();
+        while (editing)
+        {
+            version = tree_editor_acquire(editor);
+            for (size_t i = 0; i < 1024; ++i)
+                tree_edit_eval(version->tree, records.data() + i * width);
+            walks += 1024;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // replace, insert, remove and edits bringing new names
+    std::mt19937_64 rng(7);
+    const int edits = 300;
+    double seconds[4] = {};
+    int counts[4] = {};
+    for (int i = 0; i < edits; ++i)
+    {
+        auto version = tree_editor_acquire(editor);
+
+        int kind = i % 3;
+        bool fresh = i % 10 == 0 && kind != 2;
+        std::vector<uint32_t> path = bench_edit_path(rng, version->root.get(), kind == 1 ? 4 : 5);
+
+        const TreeEditNode* node = version->root.get();
+        for (uint32_t step : path) node = node->choices[step].get();
+
+        // small subtrees, reusing result names unless fresh
+        TreeNode subtree = bench_build_decision_tree(2, 10, 0, 1999999, leaf);
+        if (!fresh)
+        {
+            for (auto& choice : subtree.choices)
+                for (auto& result : choice.choices)
+                    result.name = "leaf" + std::to_string(rng() % leaves);
+        }
+
+        auto edit_start = std::chrono::steady_clock::now();
+        if (kind == 0)
+        {
+            subtree.value = node->value;
+            tree_editor_replace(editor, path.data(), path.size(), subtree);
+        }
+        else if (kind == 1)
+        {
+            // choices are tried in order, the inserted one shadows part of its later siblings
+            subtree.value = DecisionExpr{ DecisionOp::LT, 1000 };
+            tree_editor_insert(editor, path.data(), path.size(), (uint32_t)(rng() % (node->choices.size() + 1)), subtree);
+        }
+        else
+        {
+            tree_editor_remove(editor, path.data(), path.size());
+        }
+
+        int bucket = fresh ? 3 : kind;
+        seconds[bucket] += bench_seconds(edit_start);
+        counts[bucket]++;
+    }
+
+    editing = false;
+    reader.join();
+
+    // the edited compiled tree has to agree with the edited source, no edits
+    // run anymore so the pool is read directly
+    auto version = tree_editor_acquire(editor);
+    TreeNode edited = tree_edit_materialize(*version->root);
+    const SymbolPool& symbols = version->symbols->pool;
+    const FeatureSet& features = *version->features;
+
+    size_t count = 100000;
+    auto records = bench_records(symbols, features, count, 1, 0, 1999999);
+    size_t width = features.symbols.size();
+    size_t mismatches = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int64_t* record = records.data() + i * width;
+        const TreeNode* expected = bench_walk_record(&edited, symbols, features, record);
+        uint32_t node = tree_edit_eval(version->tree, record);
+
+        std::string_view name = node != COMPILED_NONE ? symbol_pool_get(symbols, tree_edit_name(version->tree, node)) : std::string_view();
+        if (name != (expected ? std::string_view(expected->name) : std::string_view())) mismatches++;
+    }
+
+    printf("editing (%zu nodes): full compile %.1f ms\n", bench_count_nodes(root), full * 1e3);
+    const char* labels[] = { "replace", "insert", "remove", "new names" };
+    for (int k = 0; k < 4; ++k)
+        printf("  %-9s %8.1f ms/edit (%d edits)\n", labels[k], seconds[k] / counts[k] * 1e3, counts[k]);
+    printf("  version %llu, %zu of %zu compiled nodes garbage, %zu reader walks, %zu mismatches\n",
+        (unsigned long long)version->number, version->garbage, (size_t)version->tree.size, walks.load(), mismatches);
+}
+
+// ------------------------------------------------------------------------
+// deltas
+// ------------------------------------------------------------------------
+static TreeNode* bench_random_node(std::mt19937_64& rng, TreeNode* node, int depth)
+{
+    for (int i = 0; i < depth && !node->choices.empty(); ++i)
+        node = &node->choices[rng() % node->choices.size()];
+    return node;
+}
+
+static void bench_delta()
+{
+    const char* from_filename = "bench_delta.xml";
+    const char* to_filename = "bench_delta_new.xml";
+    if (!bench_generate_decision_tree(from_filename, 6, 10)) return;
+
+    TreeWalker from;
+    if (!tree_walker_load(from, from_filename)) return;
+
+    // a typical update: some results renamed, some thresholds moved, a few
+    // choices added and removed
+    TreeWalker to = from;
+    std::mt19937_64 rng(11);
+    for (int i = 0; i < 20; ++i)
+    {
+        std::string name = "patched" + std::to_string(i);
+        bench_random_node(rng, &to.root, 6)->name = name;
+        tree_walker_set_result(to, name, "Patched result " + std::to_string(i) + ".");
+    }
+
+    for (int i = 0; i < 10; ++i)
+    {
+        TreeNode* node = bench_random_node(rng, &to.root, 1 + (int)(rng() % 5));
+        auto& expr = std::get<DecisionExpr>(node->value);
+        if (expr.op == DecisionOp::BETWEEN) expr.value2 -= 1;
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        TreeNode* node = bench_random_node(rng, &to.root, 5);
+        node->choices.insert(node->choices.begin(), { NodeType::FINAL, "inserted" + std::to_string(i), DecisionExpr{ DecisionOp::LT, 100 } });
+        bench_random_node(rng, &to.root, 4)->choices.pop_back();
+    }
+
+    tree_walker_save(to, to_filename);
+
+    auto start = std::chrono::steady_clock::now();
+    TreeWalker reloaded;
+    tree_walker_load(reloaded, to_filename);
+    double reload = bench_seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    TreeDelta delta = tree_delta_diff(from, to);
+    double diff = bench_seconds(start);
+
+    FILE* file = tmpfile();
+    if (!file) return;
+    tree_delta_write(delta, file);
+    long bytes = ftell(file);
+    rewind(file);
+
+    TreeDelta shipped;
+    tree_delta_read(shipped, file);
+    fclose(file);
+
+    start = std::chrono::steady_clock::now();
+    tree_delta_apply(from, shipped);
+    double apply = bench_seconds(start);
+    TreeDelta rest = tree_delta_diff(from, to);
+    bool same = rest.entries.empty() && rest.texts.empty();
+
+    // and once more against a live editor, reverting the patch
+    TreeEditor editor;
+    tree_editor_open(editor, to.root);
+    TreeNode original;
+    {
+        TreeWalker walker;
+        tree_walker_load(walker, from_filename);
+        original = std::move(walker.root);
+    }
+    TreeDelta revert = tree_delta_diff(to.root, original);
+
+    start = std::chrono::steady_clock::now();
+    tree_delta_apply(editor, revert);
+    double live = bench_seconds(start);
+    same = same && tree_delta_diff(tree_edit_materialize(*tree_editor_acquire(editor)->root), original).entries.empty();
+
+    FILE* xml = fopen(to_filename, "rb");
+    long xml_bytes = 0;
+    if (xml)
+    {
+        fseek(xml, 0, SEEK_END);
+        xml_bytes = ftell(xml);
+        fclose(xml);
+    }
+
+    printf("delta (%zu nodes): %zu entries, %zu texts, %ld bytes vs %.1f MB of XML\n",
+        bench_count_nodes(to.root), delta.entries.size(), delta.texts.size(), bytes, xml_bytes / 1e6);
+    printf("  diff %.1f ms, apply %.1f us, apply to editor %.1f ms, reload XML %.1f ms, %s\n",
+        diff * 1e3, apply * 1e6, live * 1e3, reload * 1e3, same ? "patched trees match" : "patched trees differ");
+
+    std::remove(from_filename);
+    std::remove(to_filename);
+}
+
+// ------------------------------------------------------------------------
+// memory accounting
+// ------------------------------------------------------------------------
+#ifdef __GLIBC__
+static size_t bench_heap_used()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+#else
+static size_t bench_heap_used() { return 0; }
+#endif
+
+// accounted heap against what malloc reports for the loaded walker and
+// for the document alone
+static void bench_memory_tree(const char* filename)
+{
+    TreeMemory memory = {};
+    size_t before = bench_heap_used();
+    size_t walker_heap = 0;
+    {
+        TreeWalker walker;
+        if (!tree_memory_load(memory, walker, filename)) return;
+        walker_heap = bench_heap_used() - before;
+    }
+
+    before = bench_heap_used();
+    size_t dom_heap = 0;
+    {
+        tinyxml2::XMLDocument doc;
+        doc.LoadFile(filename);
+        dom_heap = bench_heap_used() - before;
+    }
+
+    // the walker itself is on the stack here
+    size_t accounted = tree_memory_total(memory).heap - sizeof(TreeWalker);
+    size_t dom = memory.parts[(size_t)TreeMemoryPart::DOM].heap;
+
+    printf("memory (%s):\n", filename);
+    tree_memory_print(memory);
+    printf("  malloc reports %zu walker bytes (%+.2f%%), %zu dom bytes (%+.2f%%)\n",
+        walker_heap, 100.0 * ((double)accounted - walker_heap) / walker_heap,
+        dom_heap, 100.0 * ((double)dom - dom_heap) / dom_heap);
+}
+
+// the same tree with all, lazy and no text
+static void bench_memory_text(const char* filename, const TreeWalker& expected)
+{
+    const char* names[] = { "all", "lazy", "none" };
+    printf("  text %10s %14s %10s\n", "load", "heap", "first use");
+
+    for (TreeWalkerText mode : { TreeWalkerText::ALL, TreeWalkerText::LAZY, TreeWalkerText::NONE })
+    {
+        TreeWalker walker;
+        auto start = std::chrono::steady_clock::now();
+        if (!tree_walker_load(walker, filename, mode)) return;
+        double load = bench_seconds(start);
+
+        TreeMemory memory = {};
+        tree_memory_walker(memory, walker);
+        size_t heap = tree_memory_total(memory).heap;
+
+        // the lazy walker reads its text here
+        start = std::chrono::steady_clock::now();
+        size_t matches = 0;
+        for (const auto& entry : expected.results)
+        {
+            std::string_view text = tree_walker_result(walker, symbol_pool_get(*expected.symbols, entry.symbol));
+            matches += !text.empty() && text == tree_walker_text(expected, entry.text);
+        }
+        double first = bench_seconds(start);
+
+        printf("  %-4s %7.1f ms %11.1f MB %7.1f ms, %zu of %zu result texts match\n",
+            names[(int)mode], load * 1e3, heap / 1e6, first * 1e3, matches, expected.results.size());
+    }
+}
+
+static void bench_memory()
+{
+    // long result names with a text each, so every part allocates; trees
+    // this size keep malloc's caches out of the comparison
+    TreeWalker walker;
+    long long leaf = 0;
+    walker.root = bench_build_decision_tree(5, 10, 0, 1999999, leaf);
+    walker.intro = tree_walker_add_text(walker, "Benchmark tree for the memory accounting, with an intro long enough to allocate.");
+
+    std::vector<TreeNode*> stack = { &walker.root };
+    while (!stack.empty())
+    {
+        TreeNode* node = stack.back();
+        stack.pop_back();
+
+        if (node->type == NodeType::FINAL)
+        {
+            node->name = "benchmark_result_" + node->name;
+            tree_walker_set_result(walker, node->name, "The text shown for " + node->name + ".");
+        }
+        else if (tree_walker_prompt(walker, node->name).empty())
+            tree_walker_set_prompt(walker, node->name, "The prompt asking for " + node->name + "?");
+
+        for (auto& choice : node->choices)
+            stack.push_back(&choice);
+    }
+
+    if (tree_walker_save(walker, "bench_memory.xml"))
+    {
+        bench_memory_tree("bench_memory.xml");
+        bench_memory_text("bench_memory.xml", walker);
+        std::remove("bench_memory.xml");
+    }
+}
+
+// ------------------------------------------------------------------------
+// lazy loading
+// ------------------------------------------------------------------------
+static size_t bench_resident()
+{
+    long pages = 0, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(file);
+    return (size_t)resident * 4096;
+}
+
+static void bench_lazy_load()
+{
+    const char* filename = "bench_lazy.xml";
+    if (!bench_generate_decision_tree(filename, 6, 10)) return;
+
+    // the workload only takes the first two of ten top level branches
+    const size_t walks = 100000;
+    std::mt19937_64 rng(3);
+    std::vector<std::string> numbers(walks * 6);
+    for (size_t i = 0; i < numbers.size(); ++i)
+        numbers[i] = std::to_string(i % 6 == 0 ? rng() % 400000 : rng() % 2000000);
+    std::vector<std::string_view> answers(numbers.begin(), numbers.end());
+
+    std::vector<const TreeNode*> lazy_results(walks);
+    size_t heap = bench_heap_used();
+    size_t resident = bench_resident();
+
+    auto start = std::chrono::steady_clock::now();
+    TreeLazy lazy;
+    if (!tree_lazy_open(lazy, filename)) return;
+    double open = bench_seconds(start);
+    size_t open_heap = bench_heap_used() - heap;
+    size_t open_resident = bench_resident() - resident;
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < walks; ++i)
+        lazy_results[i] = tree_lazy_walk(lazy, answers.data() + i * 6, 6);
+    double walk = bench_seconds(start);
+    size_t walk_heap = bench_heap_used() - heap;
+    size_t walk_resident = bench_resident() - resident;
+
+    heap = bench_heap_used();
+    resident = bench_resident();
+    start = std::chrono::steady_clock::now();
+    TreeWalker walker;
+    tree_walker_load(walker, filename);
+    double load = bench_seconds(start);
+    size_t load_heap = bench_heap_used() - heap;
+    size_t load_resident = bench_resident() - resident;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < walks; ++i)
+    {
+        const TreeNode* expected = decision_tree_walk(&walker.root, answers.data() + i * 6, 6);
+        if (!expected != !lazy_results[i] || (expected && expected->name != lazy_results[i]->name)) mismatches++;
+    }
+
+    printf("lazy load (%zu MB, %zu branches):\n", lazy.size >> 20, lazy.branches.size());
+    printf("  full load    %8.1f ms, %7.1f MB heap, %7.1f MB resident\n", load * 1e3, load_heap / 1e6, load_resident / 1e6);
+    printf("  lazy open    %8.1f ms, %7.1f MB heap, %7.1f MB resident\n", open * 1e3, open_heap / 1e6, open_resident / 1e6);
+    printf("  + %zu walks %8.1f ms, %7.1f MB heap, %7.1f MB resident, %zu branches parsed, %zu mismatches\n",
+        walks, walk * 1e3, walk_heap / 1e6, walk_resident / 1e6, tree_lazy_parsed(lazy), mismatches);
+
+    tree_lazy_close(lazy);
+    std::remove(filename);
+}
+
+static void bench_parallel_load()
+{
+    const char* filename = "bench_parallel.xml";
+    if (!bench_generate_decision_tree(filename, 6, 10)) return;
+
+    TreeWalker expected;
+    auto start = std::chrono::steady_clock::now();
+    tree_walker_load(expected, filename);
+    printf("parallel load (%zu nodes): tree_walker_load %.1f ms\n", bench_count_nodes(expected.root), bench_seconds(start) * 1e3);
+
+    for (size_t threads : { 1, 2, 4, 8, 16 })
+    {
+        TreeWalker walker;
+        start = std::chrono::steady_clock::now();
+        int loaded = tree_lazy_load(walker, filename, threads);
+        double seconds = bench_seconds(start);
+
+        bool same = loaded && tree_delta_diff(expected.root, walker.root).entries.empty();
+        printf("  %2zu threads %8.1f ms, %s\n", threads, seconds * 1e3, same ? "same tree" : "different tree");
+    }
+
+    // prompts, results and the intro come out the same as well
+    const char* texts = "res/job.xml";
+    TreeWalker a, b;
+    if (tree_walker_load(a, texts) && tree_lazy_load(b, texts, 4))
+    {
+        // the blobs of both walkers can be ordered differently
+        TreeDelta diff = tree_delta_diff(a, b);
+        bool same = diff.entries.empty() && diff.texts.empty();
+        printf("  %s: %s\n", texts, same ? "same walker" : "different walker");
+    }
+
+    std::remove(filename);
+}
+
+// ------------------------------------------------------------------------
+// succinct tree
+// ------------------------------------------------------------------------
+static void bench_louds()
+{
+    const int depth = 7;
+    const int fanout = 10;
+    const int64_t hi = 1999999;
+
+    long long leaf = 0;
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    {
+        TreeNode root = bench_build_decision_tree(depth, fanout, 0, hi, leaf);
+        if (!compiled_tree_build(tree, root, symbols, features)) return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    LoudsTree louds;
+    if (!louds_tree_build(louds, tree)) return;
+    double build = bench_seconds(start);
+
+    const size_t count = 2000000;
+    auto records = bench_records(symbols, features, count, fanout, 0, hi);
+    size_t width = features.symbols.size();
+
+    double nodes = (double)tree.nodes.size();
+    printf("succinct tree (%zu nodes, built in %.0f ms):\n", tree.nodes.size(), build * 1e3);
+    printf("  compiled %8.1f MB, %5.2f bytes/node\n", compiled_tree_bytes(tree) / 1e6, compiled_tree_bytes(tree) / nodes);
+    printf("  louds    %8.1f MB, %5.2f bytes/node, topology %.2f bits/node\n",
+        louds_tree_bytes(louds) / 1e6, louds_tree_bytes(louds) / nodes, louds_tree_topology_bytes(louds) * 8 / nodes);
+
+    std::vector<uint32_t> expected(count);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        expected[i] = compiled_tree_eval(tree, records.data() + i * width);
+    double seconds = bench_seconds(start);
+    printf("  compiled_tree_eval %7.1f ns/record\n", seconds * 1e9 / count);
+
+    // a fresh compiled tree is breadth first already, so the ids agree
+    size_t mismatches = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i)
+        mismatches += louds_tree_eval(louds, records.data() + i * width) != expected[i];
+    seconds = bench_seconds(start);
+    printf("  louds_tree_eval    %7.1f ns/record (%zu mismatches)\n", seconds * 1e9 / count, mismatches);
+
+    // the same tree streamed level by level, never built as nodes
+    start = std::chrono::steady_clock::now();
+    LoudsTree streamed;
+    LoudsBuilder builder;
+    louds_builder_begin(builder, streamed, {});
+
+    int64_t step = (hi + 1) / fanout;
+    long long leaves = 0;
+    for (int level = depth; level >= 0; --level)
+    {
+        uint32_t var = level > 0 ? feature_set_add(features, symbol_pool_intern(symbols, "var" + std::to_string(level)), NodeType::DECISION) : COMPILED_NONE;
+        uint32_t name = level > 0 ? features.symbols[var] : 0;
+
+        long long level_nodes = 1;
+        for (int i = level; i < depth; ++i) level_nodes *= fanout;
+
+        for (long long i = 0; i < level_nodes; ++i)
+        {
+            int64_t a = (i % fanout) * step;
+            int64_t b = i % fanout == fanout - 1 ? hi : a + step - 1;
+
+            PackedNode node = { (uint8_t)NodeType::DECISION, (uint8_t)PackedOp::INTERVAL, (uint16_t)fanout, 0, (int32_t)a, (int32_t)b };
+            if (level == depth)
+                node = { (uint8_t)NodeType::DECISION, (uint8_t)PackedOp::NONE, (uint16_t)fanout, 0, 0, 0 };
+            if (level == 0)
+            {
+                node.type = (uint8_t)NodeType::FINAL;
+                node.count = 0;
+                name = symbol_pool_intern(symbols, "leaf" + std::to_string(leaves++));
+            }
+
+            if (!louds_builder_add(builder, node, var, name)) return;
+        }
+    }
+    if (!louds_builder_end(builder)) return;
+    double stream = bench_seconds(start);
+
+    const char* filename = "bench_louds.bin";
+    start = std::chrono::steady_clock::now();
+    louds_tree_save(streamed, symbols, features, filename);
+    double save = bench_seconds(start);
+
+    SymbolPool loaded_symbols;
+    FeatureSet loaded_features;
+    LoudsTree loaded;
+    start = std::chrono::steady_clock::now();
+    louds_tree_load(loaded, loaded_symbols, loaded_features, filename);
+    double load = bench_seconds(start);
+    std::remove(filename);
+
+    mismatches = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t node = louds_tree_eval(loaded, records.data() + i * width);
+        mismatches += node == COMPILED_NONE || symbol_pool_get(loaded_symbols, louds_tree_name(loaded, node)) != symbol_pool_get(symbols, tree.names[expected[i]]);
+    }
+    printf("  streamed build %.0f ms, save %.0f ms, load %.0f ms (%zu mismatches)\n", stream * 1e3, save * 1e3, load * 1e3, mismatches);
+}
+
+// ------------------------------------------------------------------------
+// registry
+// ------------------------------------------------------------------------
+// Every registry tree is checked against the same file compiled on its own.
+// The records are written in the symbols of that reference and translated by
+// name into the registry's pool.
+struct BenchRegistryTree
+{
+    std::string id;
+    std::string filename;
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    std::vector<int64_t> records;
+};
+
+static const size_t bench_registry_records = 256;
+
+static int bench_registry_reference(BenchRegistryTree& expected, const char* id, const char* filename, int fanout)
+{
+    expected.id = id;
+    expected.filename = filename;
+
+    TreeWalker walker;
+    if (!tree_walker_load(walker, filename, TreeWalkerText::NONE)
+        || !compiled_tree_build(expected.tree, walker.root, expected.symbols, expected.features))
+        return 0;
+
+    expected.records = bench_records(expected.symbols, expected.features, bench_registry_records, fanout, 0, 1999999);
+    return 1;
+}
+
+// evaluate count records with both trees, returns the number of different leaves
+static size_t bench_registry_check(TreeRegistry& registry, const TreeRegistryTree& loaded, const BenchRegistryTree& expected, size_t first, size_t count)
+{
+    size_t width = expected.features.symbols.size();
+    std::vector<uint32_t> features(loaded.features.symbols.size());
+    for (size_t f = 0; f < features.size(); ++f)
+    {
+        std::string_view name = tree_registry_name(registry, loaded.features.symbols[f]);
+        features[f] = feature_set_find(expected.features, symbol_pool_find(expected.symbols, name));
+    }
+
+    std::vector<int64_t> record(features.size());
+    size_t mismatches = 0;
+    for (size_t i = first; i < first + count; ++i)
+    {
+        const int64_t* source = expected.records.data() + i % bench_registry_records * width;
+        for (size_t f = 0; f < features.size(); ++f)
+        {
+            int64_t value = features[f] != COMPILED_NONE ? source[features[f]] : 0;
+            if (loaded.features.types[f] == NodeType::OPTION)
+                value = tree_registry_symbol(registry, symbol_pool_get(expected.symbols, (uint32_t)value));
+            record[f] = value;
+        }
+
+        uint32_t a = compiled_tree_eval(loaded.tree, record.data());
+        uint32_t b = compiled_tree_eval(expected.tree, source);
+        if (a == COMPILED_NONE || b == COMPILED_NONE)
+            mismatches += a != b;
+        else
+            mismatches += tree_registry_name(registry, loaded.tree.names[a]) != symbol_pool_get(expected.symbols, expected.tree.names[b]);
+    }
+    return mismatches;
+}
+
+struct BenchRegistryWork
+{
+    TreeRegistry* registry;
+    const std::vector<BenchRegistryTree>* expected;
+    const std::vector<uint32_t>* ids;
+    size_t gets;
+    size_t seed;
+
+    size_t mismatches;
+    size_t failed;
+};
+
+static void bench_registry_work(BenchRegistryWork* work)
+{
+    std::mt19937_64 rng(work->seed);
+    std::uniform_int_distribution<size_t> pick(0, work->ids->size() - 1);
+
+    for (size_t i = 0; i < work->gets; ++i)
+    {
+        size_t index = pick(rng);
+        auto loaded = tree_registry_get(*work->registry, (*work->ids)[index]);
+        if (!loaded)
+        {
+            ++work->failed;
+            continue;
+        }
+        work->mismatches += bench_registry_check(*work->registry, *loaded, (*work->expected)[index], i * 16, 16);
+    }
+}
+
+static bool bench_registry_loading(TreeRegistry& registry, uint32_t tree)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.entries[tree].loading;
+}
+
+static void bench_registry()
+{
+    const size_t tree_count = 12;
+    const size_t threads = 4;
+
+    // half decision, half option trees, every one a different shape
+    std::vector<BenchRegistryTree> expected(tree_count);
+    for (size_t i = 0; i < tree_count; ++i)
+    {
+        int fanout = 4 + (int)i / 2;
+        std::string id = "tree" + std::to_string(i);
+        std::string filename = "bench_registry" + std::to_string(i) + ".xml";
+        int generated = i % 2 ? bench_generate_option_tree(filename.c_str(), 4, fanout)
+            : bench_generate_decision_tree(filename.c_str(), 4, fanout);
+        if (!generated || !bench_registry_reference(expected[i], id.c_str(), filename.c_str(), fanout)) return;
+    }
+
+    BenchRegistryTree big;
+    BenchRegistryTree small;
+    if (!bench_generate_decision_tree("bench_registry_big.xml", 5, 10)
+        || !bench_registry_reference(big, "big", "bench_registry_big.xml", 10)
+        || !bench_registry_reference(small, "big", expected[0].filename.c_str(), 4))
+        return;
+
+    TreeRegistry registry;
+    std::vector<uint32_t> ids;
+    for (const auto& tree : expected)
+        ids.push_back(tree_registry_add(registry, tree.id, tree.filename.c_str()));
+    uint32_t big_id = tree_registry_add(registry, big.id, big.filename.c_str());
+
+    printf("tree registry (%zu trees, %zu threads):\n", tree_count, threads);
+
+    // concurrent gets of a cold tree share one load
+    std::shared_ptr<const TreeRegistryTree> cold[threads];
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] { cold[t] = tree_registry_get(registry, big_id); });
+    for (auto& worker : workers) worker.join();
+    double concurrent = bench_seconds(start);
+
+    bool shared = cold[0] != nullptr;
+    for (size_t t = 1; t < threads; ++t)
+        shared = shared && cold[t] == cold[0];
+    size_t mismatches = cold[0] ? bench_registry_check(registry, *cold[0], big, 0, bench_registry_records) : 1;
+
+    // evicting while a caller holds the tree keeps it usable
+    tree_registry_set_budget(registry, 0);
+    bool evicted = !registry.entries[big_id].tree;
+    mismatches += cold[0] ? bench_registry_check(registry, *cold[0], big, 0, bench_registry_records) : 1;
+    tree_registry_set_budget(registry, SIZE_MAX);
+
+    start = std::chrono::steady_clock::now();
+    auto reloaded = tree_registry_get(registry, big_id);
+    double single = bench_seconds(start);
+    bool fresh = reloaded && reloaded != cold[0];
+
+    printf("  cold get by %zu threads %.1f ms, one get %.1f ms, %s, %s while held, reload %s\n",
+        threads, concurrent * 1e3, single * 1e3, shared ? "one tree" : "different trees",
+        evicted ? "evicted" : "not evicted", fresh ? "new tree" : "same tree");
+
+    for (auto& tree : cold) tree.reset();
+    reloaded.reset();
+
+    // re-registering while a load runs, the caller gets the old file and the
+    // next get the new one
+    tree_registry_set_budget(registry, 0);
+    tree_registry_set_budget(registry, SIZE_MAX);
+
+    std::shared_ptr<const TreeRegistryTree> old_tree;
+    std::thread loader([&] { old_tree = tree_registry_get(registry, big_id); });
+    bool during = false;
+    for (int spin = 0; spin < 100000 && !during; ++spin)
+    {
+        during = bench_registry_loading(registry, big_id);
+        if (!during) std::this_thread::yield();
+    }
+    tree_registry_add(registry, big.id, small.filename.c_str());
+    auto new_tree = tree_registry_get(registry, big_id);
+    loader.join();
+
+    bool reregistered = old_tree && new_tree
+        && old_tree->tree.nodes.size() == big.tree.nodes.size()
+        && new_tree->tree.nodes.size() == small.tree.nodes.size();
+    mismatches += old_tree ? bench_registry_check(registry, *old_tree, big, 0, bench_registry_records) : 1;
+    mismatches += new_tree ? bench_registry_check(registry, *new_tree, small, 0, bench_registry_records) : 1;
+    printf("  re-register %s load: %s\n", during ? "during" : "after", reregistered ? "old caller got the old file, next get the new one" : "wrong trees");
+    old_tree.reset();
+    new_tree.reset();
+
+    // all trees once to size the budget, then three trees' worth of them
+    for (uint32_t id : ids) tree_registry_get(registry, id);
+    size_t budget;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        budget = registry.used * 3 / (tree_count + 1);
+    }
+    tree_registry_set_budget(registry, budget);
+
+    std::vector<BenchRegistryWork> work(threads);
+    workers.clear();
+    start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t)
+    {
+        work[t] = { &registry, &expected, &ids, 2000, t + 1, 0, 0 };
+        workers.emplace_back(bench_registry_work, &work[t]);
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = bench_seconds(start);
+
+    size_t failed = 0;
+    for (const auto& w : work)
+    {
+        mismatches += w.mismatches;
+        failed += w.failed;
+    }
+
+    size_t used;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        used = registry.used;
+    }
+    printf("  %zu gets under a %.0f kB budget: %.0f k gets/s, %zu kB used, %zu failed, %zu mismatches\n",
+        threads * 2000, budget / 1e3, threads * 2000 / seconds / 1e3, used / 1000, failed, mismatches);
+
+    // texts come from the lazy walker through the shared pool
+    const char* texts = "res/job.xml";
+    TreeWalker walker;
+    uint32_t job = tree_registry_add(registry, "job", texts);
+    auto loaded = tree_registry_get(registry, job);
+    if (loaded && tree_walker_load(walker, texts))
+    {
+        size_t different = 0;
+        for (const auto& entry : walker.results)
+        {
+            std::string_view name = symbol_pool_get(*walker.symbols, entry.symbol);
+            different += tree_registry_result(registry, *loaded, name) != tree_walker_result(walker, name);
+        }
+        for (const auto& entry : walker.prompts)
+        {
+            std::string_view name = symbol_pool_get(*walker.symbols, entry.symbol);
+            different += tree_registry_prompt(registry, *loaded, name) != tree_walker_prompt(walker, name);
+        }
+        printf("  %s: %zu of %zu texts different\n", texts, different, walker.results.size() + walker.prompts.size());
+    }
+
+    for (const auto& tree : expected) std::remove(tree.filename.c_str());
+    std::remove(big.filename.c_str());
+}
+
+void run_benchmarks()
+{
+    bench_load();
+    bench_footprint();
+    bench_interleaved();
+    bench_ensemble();
+    bench_bitvector();
+    bench_batch();
+    bench_lazy();
+    bench_binding();
+    bench_replica();
+    bench_pages();
+    bench_layout();
+    bench_table();
+    bench_edit();
+    bench_delta();
+    bench_memory();
+    bench_lazy_load();
+    bench_parallel_load();
+    bench_louds();
+    bench_registry();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// ------------------------------------------------------------------------
+// benchmarks
+// ------------------------------------------------------------------------
+// Generated trees are written to the working directory (bench_*.xml).
+void run_benchmarks();
@@ -0,0 +1,214 @@
+#include "bitvector_tree.h"
+
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static uint32_t bitvector_first_bit(uint64_t word)
+{
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (uint32_t)index;
+}
+#else
+static uint32_t bitvector_first_bit(uint64_t word)
+{
+    return (uint32_t)__builtin_ctzll(word);
+}
+#endif
+
+#define BITVECTOR_MAX_LEAVES (1u << 24)
+
+struct BitvectorRun
+{
+    int64_t start;
+    uint32_t node;
+};
+
+// ------------------------------------------------------------------------
+// building
+// ------------------------------------------------------------------------
+// bounds of the predicate leading into a choice, to find the segment starts
+static void bitvector_add_bounds(const CompiledTree& tree, const PackedNode& choice, std::vector<int64_t>& starts)
+{
+    auto add = [&](int64_t lo, int64_t hi)
+    {
+        starts.push_back(lo);
+        if (hi != INT64_MAX) starts.push_back(hi + 1);
+    };
+
+    switch ((PackedOp)choice.op)
+    {
+    case PackedOp::INTERVAL:
+    case PackedOp::OUTSIDE:
+        add(choice.lo == INT32_MIN ? INT64_MIN : choice.lo, choice.hi == INT32_MAX ? INT64_MAX : choice.hi);
+        break;
+    case PackedOp::SYMBOL:
+        add((uint32_t)choice.lo, (uint32_t)choice.lo);
+        break;
+    case PackedOp::SET:
+        for (int32_t i = 0; i < choice.hi; ++i)
+            add(tree.intervals[choice.lo + i].lo, tree.intervals[choice.lo + i].hi);
+        break;
+    default:
+        break;
+    }
+}
+
+// the segments of a node, neighbouring segments leading to the same choice are merged
+static std::vector<BitvectorRun> bitvector_runs(const CompiledTree& tree, uint32_t node)
+{
+    const PackedNode& parent = tree.nodes[node];
+
+    std::vector<int64_t> starts = { INT64_MIN };
+    for (uint32_t i = parent.child; i < parent.child + parent.count; ++i)
+        bitvector_add_bounds(tree, tree.nodes[i], starts);
+
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    std::vector<BitvectorRun> runs;
+    for (int64_t start : starts)
+    {
+        uint32_t target = compiled_tree_step(tree, node, start);
+        if (runs.empty() || runs.back().node != target)
+            runs.push_back({ start, target });
+    }
+    return runs;
+}
+
+struct BitvectorBuilder
+{
+    const CompiledTree* tree;
+    std::vector<std::vector<BitvectorEntry>> features;
+    std::vector<uint32_t> leaves;
+};
+
+// append the leaves of a (virtual) subtree in order, node may be COMPILED_NONE
+static int bitvector_build_node(BitvectorBuilder& builder, uint32_t node)
+{
+    if (builder.leaves.size() >= BITVECTOR_MAX_LEAVES)
+    {
+        printf("[warn] Tree has too many leaves for bitvector evaluation.\n");
+        return 0;
+    }
+
+    const CompiledTree& tree = *builder.tree;
+    if (node == COMPILED_NONE || tree.nodes[node].type == (uint8_t)NodeType::FINAL)
+    {
+        builder.leaves.push_back(node);
+        return 1;
+    }
+
+    auto& entries = builder.features[tree.vars[node]];
+
+    uint32_t previous = 0;
+    auto runs = bitvector_runs(tree, node);
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        uint32_t first = (uint32_t)builder.leaves.size();
+
+        // reaching this run rules out the leaves of the run before it
+        if (i > 0)
+            entries.push_back({ runs[i].start, previous, first });
+
+        if (!bitvector_build_node(builder, runs[i].node))
+            return 0;
+
+        previous = first;
+    }
+    return 1;
+}
+
+int bitvector_tree_build(BitvectorTree& bits, const CompiledTree& tree, size_t feature_count)
+{
+    BitvectorBuilder builder = { &tree, std::vector<std::vector<BitvectorEntry>>(feature_count) };
+    if (!bitvector_build_node(builder, 0))
+        return 0;
+
+    bits.entries.clear();
+    bits.offsets.clear();
+    for (auto& entries : builder.features)
+    {
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const BitvectorEntry& a, const BitvectorEntry& b) { return a.threshold < b.threshold; });
+
+        bits.offsets.push_back((uint32_t)bits.entries.size());
+        bits.entries.insert(bits.entries.end(), entries.begin(), entries.end());
+    }
+    bits.offsets.push_back((uint32_t)bits.entries.size());
+    bits.leaves = std::move(builder.leaves);
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+// evaluation
+// ------------------------------------------------------------------------
+static void bitvector_clear(uint64_t* words, uint32_t lo, uint32_t hi)
+{
+    if (lo >= hi) return;
+
+    uint32_t first = lo >> 6;
+    uint32_t last = (hi - 1) >> 6;
+    uint64_t head = ~0ull << (lo & 63);
+    uint64_t tail = ~0ull >> (63 - ((hi - 1) & 63));
+
+    if (first == last)
+    {
+        words[first] &= ~(head & tail);
+        return;
+    }
+
+    words[first] &= ~head;
+    for (uint32_t w = first + 1; w < last; ++w)
+        words[w] = 0;
+    words[last] &= ~tail;
+}
+
+uint32_t bitvector_tree_eval(const BitvectorTree& bits, const int64_t* record, uint64_t* words)
+{
+    size_t features = bits.offsets.size() - 1;
+    size_t word_count = (bits.leaves.size() + 63) / 64;
+
+    // small trees keep the leaves in a register
+    if (word_count == 1)
+    {
+        uint64_t word = ~0ull;
+        for (size_t f = 0; f < features; ++f)
+        {
+            int64_t value = record[f];
+            const BitvectorEntry* entry = bits.entries.data() + bits.offsets[f];
+            const BitvectorEntry* end = bits.entries.data() + bits.offsets[f + 1];
+            for (; entry < end && entry->threshold <= value; ++entry)
+                word &= ~((~0ull << entry->lo) & (~0ull >> (64 - entry->hi)));
+        }
+        return word ? bits.leaves[bitvector_first_bit(word)] : COMPILED_NONE;
+    }
+
+    std::fill(words, words + word_count, ~0ull);
+    for (size_t f = 0; f < features; ++f)
+    {
+        int64_t value = record[f];
+
+        // thresholds are sorted, stop at the first one above the value
+        const BitvectorEntry* entry = bits.entries.data() + bits.offsets[f];
+        const BitvectorEntry* end = bits.entries.data() + bits.offsets[f + 1];
+        for (; entry < end && entry->threshold <= value; ++entry)
+            bitvector_clear(words, entry->lo, entry->hi);
+    }
+
+    for (size_t w = 0; w < word_count; ++w)
+    {
+        if (words[w])
+            return bits.leaves[w * 64 + bitvector_first_bit(words[w])];
+    }
+    return COMPILED_NONE;
+}
+
+void bitvector_tree_eval_batch(const BitvectorTree& bits, const int64_t* records, size_t width, size_t count, uint32_t* results)
+{
+    std::vector<uint64_t> words((bits.leaves.size() + 63) / 64);
+    for (size_t i = 0; i < count; ++i)
+        results[i] = bitvector_tree_eval(bits, records + i * width, words.data());
+}
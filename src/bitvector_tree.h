@@ -0,0 +1,37 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+// ------------------------------------------------------------------------
+// bitvector tree
+// ------------------------------------------------------------------------
+// QuickScorer style evaluation of a CompiledTree. The value range of every
+// decision/option node is cut into segments that each lead to one choice
+// (or to no result). Seen as an ordered list of virtual children, passing
+// the start of a segment rules out all leaves of the segment before it.
+//
+// The thresholds of all nodes are grouped by feature and sorted. A record
+// starts with all leaves alive, then every feature walks its thresholds up
+// to the record value and clears the ruled out leaf ranges. The leftmost
+// leaf still alive is the exit leaf. Choices spanning several segments get
+// their subtree repeated once per segment.
+struct BitvectorEntry
+{
+    int64_t threshold;
+    uint32_t lo;
+    uint32_t hi;
+};
+
+struct BitvectorTree
+{
+    std::vector<BitvectorEntry> entries;    // grouped by feature, sorted by threshold
+    std::vector<uint32_t> offsets;          // first entry of every feature, one past the end at the back
+    std::vector<uint32_t> leaves;           // compiled node of every leaf, COMPILED_NONE for no result
+};
+
+int bitvector_tree_build(BitvectorTree& bits, const CompiledTree& tree, size_t feature_count);
+
+// words has to hold (leaves.size() + 63) / 64 values
+uint32_t bitvector_tree_eval(const BitvectorTree& bits, const int64_t* record, uint64_t* words);
+
+void bitvector_tree_eval_batch(const BitvectorTree& bits, const int64_t* records, size_t width, size_t count, uint32_t* results);
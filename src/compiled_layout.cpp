@@ -0,0 +1,162 @@
+#include "compiled_layout.h"
+
+#include <algorithm>
+
+// blocks are named by the node owning them
+static void compiled_layout_children(const CompiledTree& tree, uint32_t block, std::vector<uint32_t>& children)
+{
+    const PackedNode& parent = tree.nodes[block];
+    for (uint32_t c = parent.child; c < parent.child + parent.count; ++c)
+        if (tree.nodes[c].count) children.push_back(c);
+}
+
+static std::vector<uint32_t> compiled_layout_bfs(const CompiledTree& tree)
+{
+    std::vector<uint32_t> order;
+    if (tree.nodes[0].count) order.push_back(0);
+
+    // the order doubles as the queue
+    for (size_t i = 0; i < order.size(); ++i)
+        compiled_layout_children(tree, order[i], order);
+
+    return order;
+}
+
+static std::vector<uint32_t> compiled_layout_dfs(const CompiledTree& tree, const uint64_t* visits)
+{
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> stack;
+    std::vector<uint32_t> children;
+    if (tree.nodes[0].count) stack.push_back(0);
+
+    while (!stack.empty())
+    {
+        uint32_t block = stack.back();
+        stack.pop_back();
+        order.push_back(block);
+
+        children.clear();
+        compiled_layout_children(tree, block, children);
+        if (visits)
+        {
+            std::stable_sort(children.begin(), children.end(),
+                [=](uint32_t a, uint32_t b) { return visits[a] > visits[b]; });
+        }
+
+        // first child on top of the stack
+        stack.insert(stack.end(), children.rbegin(), children.rend());
+    }
+    return order;
+}
+
+static void compiled_layout_veb(const CompiledTree& tree, uint32_t block, uint32_t height, std::vector<uint32_t>& order)
+{
+    if (height == 1)
+    {
+        order.push_back(block);
+        return;
+    }
+
+    uint32_t top = height / 2;
+    compiled_layout_veb(tree, block, top, order);
+
+    // then every subtree hanging below the top levels
+    std::vector<uint32_t> frontier = { block };
+    std::vector<uint32_t> next;
+    for (uint32_t level = 0; level < top; ++level)
+    {
+        next.clear();
+        for (uint32_t b : frontier)
+            compiled_layout_children(tree, b, next);
+        frontier.swap(next);
+    }
+
+    for (uint32_t b : frontier)
+        compiled_layout_veb(tree, b, height - top, order);
+}
+
+static std::vector<uint32_t> compiled_layout_veb(const CompiledTree& tree)
+{
+    std::vector<uint32_t> order;
+    if (!tree.nodes[0].count) return order;
+
+    // height in blocks, children come after their parent in breadth first order
+    std::vector<uint32_t> bfs = compiled_layout_bfs(tree);
+    std::vector<uint32_t> heights(tree.nodes.size(), 0);
+    std::vector<uint32_t> children;
+    for (auto it = bfs.rbegin(); it != bfs.rend(); ++it)
+    {
+        children.clear();
+        compiled_layout_children(tree, *it, children);
+
+        uint32_t height = 0;
+        for (uint32_t c : children)
+            height = std::max(height, heights[c]);
+        heights[*it] = height + 1;
+    }
+
+    compiled_layout_veb(tree, 0, heights[0], order);
+    return order;
+}
+
+std::vector<uint64_t> compiled_tree_profile(const CompiledTree& tree, const int64_t* records, size_t width, size_t count)
+{
+    std::vector<uint64_t> visits(tree.nodes.size(), 0);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int64_t* record = records + i * width;
+
+        uint32_t node = 0;
+        while (node != COMPILED_NONE)
+        {
+            visits[node]++;
+            if (tree.nodes[node].type == (uint8_t)NodeType::FINAL) break;
+            node = compiled_tree_step(tree, node, record[tree.vars[node]]);
+        }
+    }
+    return visits;
+}
+
+void compiled_tree_relayout(CompiledTree& tree, TreeLayout layout, const uint64_t* visits)
+{
+    if (tree.nodes.empty()) return;
+
+    std::vector<uint32_t> order;
+    switch (layout)
+    {
+    case TreeLayout::BFS: order = compiled_layout_bfs(tree); break;
+    case TreeLayout::DFS: order = compiled_layout_dfs(tree, nullptr); break;
+    case TreeLayout::VEB: order = compiled_layout_veb(tree); break;
+    case TreeLayout::HOT: order = compiled_layout_dfs(tree, visits); break;
+    }
+
+    // new position of every reachable node, the root stays first
+    std::vector<uint32_t> position(tree.nodes.size(), COMPILED_NONE);
+    uint32_t next = 1;
+    position[0] = 0;
+    for (uint32_t block : order)
+    {
+        const PackedNode& parent = tree.nodes[block];
+        for (uint32_t c = parent.child; c < parent.child + parent.count; ++c)
+            position[c] = next++;
+    }
+
+    CompiledTree result;
+    result.nodes.resize(next);
+    result.vars.resize(next);
+    result.names.resize(next);
+    for (uint32_t i = 0; i < tree.nodes.size(); ++i)
+    {
+        if (position[i] == COMPILED_NONE) continue;
+
+        PackedNode node = tree.nodes[i];
+        if (node.count) node.child = position[node.child];
+
+        result.nodes[position[i]] = node;
+        result.vars[position[i]] = tree.vars[i];
+        result.names[position[i]] = tree.names[i];
+    }
+    result.intervals = std::move(tree.intervals);
+
+    tree = std::move(result);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+// ------------------------------------------------------------------------
+// compiled tree layouts
+// ------------------------------------------------------------------------
+// The choices of a node always form one block (their order decides which
+// matches first), a layout decides the order of the blocks:
+//
+//   BFS  level by level, as compiled
+//   DFS  every block followed by the blocks below it
+//   VEB  van Emde Boas: the top half of the levels first, then each subtree
+//        below it, recursively, so any path crosses few distant blocks
+//   HOT  depth first, taking the most visited choice first, so the block
+//        of the hottest choice sits right behind its parent's block
+enum class TreeLayout
+{
+    BFS,
+    DFS,
+    VEB,
+    HOT
+};
+
+// number of times every node is visited by walking the records
+std::vector<uint64_t> compiled_tree_profile(const CompiledTree& tree, const int64_t* records, size_t width, size_t count);
+
+// visits is only needed for HOT, one count per node. Nodes no longer
+// reachable (see compiled_tree_graft) are dropped.
+void compiled_tree_relayout(CompiledTree& tree, TreeLayout layout, const uint64_t* visits = nullptr);
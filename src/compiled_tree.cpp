@@ -0,0 +1,299 @@
+#include "compiled_tree.h"
+
+#include <algorithm>
+#include <deque>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define COMPILED_PREFETCH(ptr) _mm_prefetch((const char*)(ptr), _MM_HINT_T0)
+#else
+#define COMPILED_PREFETCH(ptr) __builtin_prefetch(ptr)
+#endif
+
+// ------------------------------------------------------------------------
+// features
+// ------------------------------------------------------------------------
+uint32_t feature_set_add(FeatureSet& features, uint32_t symbol, NodeType type)
+{
+    auto found = features.index.find(symbol);
+    if (found != features.index.end()) return found->second;
+
+    uint32_t feature = (uint32_t)features.symbols.size();
+    features.symbols.push_back(symbol);
+    features.types.push_back(type);
+    features.index.emplace(symbol, feature);
+    return feature;
+}
+
+uint32_t feature_set_find(const FeatureSet& features, uint32_t symbol)
+{
+    auto found = features.index.find(symbol);
+    return found != features.index.end() ? found->second : COMPILED_NONE;
+}
+
+// ------------------------------------------------------------------------
+// building
+// ------------------------------------------------------------------------
+static bool compiled_tree_fits(int64_t value)
+{
+    return value > INT32_MIN && value < INT32_MAX;
+}
+
+// encode the predicate of a decision choice, single intervals and their
+// complement are stored inline, everything else goes to the interval table
+static void compiled_tree_pack_expr(CompiledTree& tree, PackedNode& node, const DecisionExpr& expr)
+{
+    IntervalSet set = decision_expr_intervals(expr);
+
+    if (set.size() == 1)
+    {
+        int64_t lo = set[0].lo;
+        int64_t hi = set[0].hi;
+        bool lo_fits = lo == INT64_MIN || compiled_tree_fits(lo);
+        bool hi_fits = hi == INT64_MAX || compiled_tree_fits(hi);
+
+        if (lo_fits && hi_fits)
+        {
+            node.op = (uint8_t)PackedOp::INTERVAL;
+            node.lo = lo == INT64_MIN ? INT32_MIN : (int32_t)lo;
+            node.hi = hi == INT64_MAX ? INT32_MAX : (int32_t)hi;
+            return;
+        }
+    }
+
+    if (set.size() == 2 && set[0].lo == INT64_MIN && set[1].hi == INT64_MAX
+        && compiled_tree_fits(set[0].hi + 1) && compiled_tree_fits(set[1].lo - 1))
+    {
+        node.op = (uint8_t)PackedOp::OUTSIDE;
+        node.lo = (int32_t)(set[0].hi + 1);
+        node.hi = (int32_t)(set[1].lo - 1);
+        return;
+    }
+
+    node.op = (uint8_t)PackedOp::SET;
+    node.lo = (int32_t)tree.intervals.size();
+    node.hi = (int32_t)set.size();
+    tree.intervals.insert(tree.intervals.end(), set.begin(), set.end());
+}
+
+// write the entry of src at index, the predicate depends on the parent type
+static void compiled_tree_pack(CompiledTree& tree, uint32_t index, const TreeNode& src, NodeType parent_type, SymbolPool& symbols, FeatureSet& features)
+{
+    PackedNode node = { (uint8_t)src.type, (uint8_t)PackedOp::NONE, 0, 0, 0, 0 };
+
+    if (parent_type == NodeType::DECISION)
+    {
+        if (auto expr = std::get_if<DecisionExpr>(&src.value))
+            compiled_tree_pack_expr(tree, node, *expr);
+    }
+    else if (parent_type == NodeType::OPTION)
+    {
+        if (auto str = std::get_if<std::string>(&src.value))
+        {
+            node.op = (uint8_t)PackedOp::SYMBOL;
+            node.lo = (int32_t)symbol_pool_intern(symbols, *str);
+        }
+    }
+
+    uint32_t name = symbol_pool_intern(symbols, src.name);
+    uint32_t var = COMPILED_NONE;
+    if (src.type == NodeType::DECISION || src.type == NodeType::OPTION)
+    {
+        var = feature_set_add(features, name, src.type);
+        if (features.types[var] != src.type)
+            printf("[warn] Variable %s is used by decision and option nodes.\n", src.name.c_str());
+    }
+
+    tree.nodes[index] = node;
+    tree.names[index] = name;
+    tree.vars[index] = var;
+}
+
+static void compiled_tree_push(CompiledTree& tree, const TreeNode& src, NodeType parent_type, SymbolPool& symbols, FeatureSet& features)
+{
+    tree.nodes.emplace_back();
+    tree.names.emplace_back();
+    tree.vars.emplace_back();
+    compiled_tree_pack(tree, (uint32_t)tree.nodes.size() - 1, src, parent_type, symbols, features);
+}
+
+// append everything below src, whose entry is at index
+static int compiled_tree_expand(CompiledTree& tree, const TreeNode& src, uint32_t index, SymbolPool& symbols, FeatureSet& features)
+{
+    // breadth first, so the choices of every node end up next to each other
+    std::deque<std::pair<const TreeNode*, uint32_t>> queue;
+    queue.push_back({ &src, index });
+    while (!queue.empty())
+    {
+        auto [node, at] = queue.front();
+        queue.pop_front();
+
+        if (node->choices.empty()) continue;
+
+        if (node->choices.size() > UINT16_MAX)
+        {
+            printf("[warn] Node %s has too many choices to compile.\n", node->name.c_str());
+            return 0;
+        }
+
+        tree.nodes[at].child = (uint32_t)tree.nodes.size();
+        tree.nodes[at].count = (uint16_t)node->choices.size();
+
+        for (const auto& choice : node->choices)
+        {
+            queue.push_back({ &choice, (uint32_t)tree.nodes.size() });
+            compiled_tree_push(tree, choice, node->type, symbols, features);
+        }
+    }
+    return 1;
+}
+
+int compiled_tree_build(CompiledTree& tree, const TreeNode& root, SymbolPool& symbols, FeatureSet& features)
+{
+    tree.nodes.clear();
+    tree.vars.clear();
+    tree.names.clear();
+    tree.intervals.clear();
+
+    compiled_tree_push(tree, root, NodeType::UNKNOWN, symbols, features);
+    if (!compiled_tree_expand(tree, root, 0, symbols, features))
+        return 0;
+
+    tree.nodes.shrink_to_fit();
+    tree.vars.shrink_to_fit();
+    tree.names.shrink_to_fit();
+    tree.intervals.shrink_to_fit();
+
+    return 1;
+}
+
+int compiled_tree_graft(CompiledTree& tree, uint32_t index, const TreeNode& src, NodeType parent_type, SymbolPool& symbols, FeatureSet& features)
+{
+    compiled_tree_pack(tree, index, src, parent_type, symbols, features);
+    return compiled_tree_expand(tree, src, index, symbols, features);
+}
+
+// ------------------------------------------------------------------------
+// evaluation
+// ------------------------------------------------------------------------
+bool compiled_tree_match(const PackedNode& node, const DecisionInterval* intervals, int64_t var)
+{
+    // inline bounds are 32 bit, clamping keeps the unbounded ends intact
+    int64_t v = std::clamp<int64_t>(var, INT32_MIN, INT32_MAX);
+    uint64_t range = (uint64_t)((int64_t)node.hi - node.lo);
+
+    switch ((PackedOp)node.op)
+    {
+    case PackedOp::INTERVAL: return (uint64_t)(v - node.lo) <= range;
+    case PackedOp::OUTSIDE:  return (uint64_t)(v - node.lo) > range;
+    case PackedOp::SYMBOL:   return (int64_t)(uint32_t)node.lo == var;
+    case PackedOp::SET:
+    {
+        const DecisionInterval* first = intervals + node.lo;
+        const DecisionInterval* last = first + node.hi;
+
+        auto next = std::upper_bound(first, last, var,
+            [](int64_t v, const DecisionInterval& i) { return v < i.lo; });
+        return next != first && var <= (next - 1)->hi;
+    }
+    default: return false;
+    }
+}
+
+uint32_t compiled_tree_step(const CompiledTree& tree, uint32_t node, int64_t var)
+{
+    const PackedNode& parent = tree.nodes[node];
+
+    uint32_t end = parent.child + parent.count;
+    for (uint32_t i = parent.child; i < end; ++i)
+    {
+        const PackedNode& choice = tree.nodes[i];
+        if (compiled_tree_match(choice, tree.intervals.data(), var))
+            return choice.type == (uint8_t)NodeType::INVALID ? COMPILED_NONE : i;
+    }
+
+    return COMPILED_NONE;
+}
+
+uint32_t compiled_tree_eval(const CompiledTree& tree, const int64_t* record)
+{
+    uint32_t node = 0;
+    while (node != COMPILED_NONE && tree.nodes[node].type != (uint8_t)NodeType::FINAL)
+        node = compiled_tree_step(tree, node, record[tree.vars[node]]);
+
+    return node;
+}
+
+struct CompiledSlot
+{
+    uint32_t node;
+    size_t record;
+};
+
+void compiled_tree_eval_batch(const CompiledTree& tree, const int64_t* records, size_t width, size_t count, uint32_t* results, size_t group)
+{
+    if (group <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            results[i] = compiled_tree_eval(tree, records + i * width);
+        return;
+    }
+
+    if (group > COMPILED_MAX_GROUP) group = COMPILED_MAX_GROUP;
+
+    const PackedNode* nodes = tree.nodes.data();
+    const uint32_t* vars = tree.vars.data();
+
+    CompiledSlot slots[COMPILED_MAX_GROUP];
+    size_t active = 0;
+    size_t next = 0;
+
+    while (active < group && next < count)
+        slots[active++] = { 0, next++ };
+
+    while (active > 0)
+    {
+        for (size_t i = 0; i < active;)
+        {
+            CompiledSlot& slot = slots[i];
+
+            uint32_t node = slot.node;
+            if (nodes[node].type != (uint8_t)NodeType::FINAL)
+            {
+                // the choices of node were prefetched in the previous turn
+                node = compiled_tree_step(tree, node, records[slot.record * width + vars[node]]);
+
+                // stepped to an inner node, fetch what its next step needs and move on
+                if (node != COMPILED_NONE && nodes[node].type != (uint8_t)NodeType::FINAL)
+                {
+                    COMPILED_PREFETCH(nodes + nodes[node].child);
+                    COMPILED_PREFETCH(vars + node);
+                    slot.node = node;
+                    i++;
+                    continue;
+                }
+            }
+
+            // done, refill the slot with the next record or shrink the group
+            results[slot.record] = node;
+            if (next < count)
+            {
+                slot = { 0, next++ };
+                i++;
+            }
+            else
+            {
+                slot = slots[--active];
+            }
+        }
+    }
+}
+
+size_t compiled_tree_bytes(const CompiledTree& tree)
+{
+    return sizeof(CompiledTree)
+        + tree.nodes.capacity() * sizeof(PackedNode)
+        + tree.vars.capacity() * sizeof(uint32_t)
+        + tree.names.capacity() * sizeof(uint32_t)
+        + tree.intervals.capacity() * sizeof(DecisionInterval);
+}
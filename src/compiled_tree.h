@@ -0,0 +1,88 @@
+#pragma once
+
+#include "tree.h"
+#include "symbol_pool.h"
+#include "tree_pages.h"
+
+// ------------------------------------------------------------------------
+// features
+// ------------------------------------------------------------------------
+// Dense ids for the variables of a tree (the names of decision and option
+// nodes), so a record can be passed as a flat array of values. Decision
+// variables hold the number, option variables the symbol id of the answer.
+struct FeatureSet
+{
+    std::vector<uint32_t> symbols;
+    std::vector<NodeType> types;
+    std::unordered_map<uint32_t, uint32_t> index;
+};
+
+uint32_t feature_set_add(FeatureSet& features, uint32_t symbol, NodeType type);
+uint32_t feature_set_find(const FeatureSet& features, uint32_t symbol);
+
+// ------------------------------------------------------------------------
+// compiled tree
+// ------------------------------------------------------------------------
+#define COMPILED_NONE UINT32_MAX
+
+// predicate leading into a node
+enum class PackedOp : uint8_t
+{
+    NONE = 0,   // root
+    INTERVAL,   // lo <= var <= hi, INT32_MIN and INT32_MAX are unbounded
+    OUTSIDE,    // var < lo || var > hi
+    SET,        // intervals[lo] .. intervals[lo + hi - 1]
+    SYMBOL,     // option value, lo is the symbol id
+    NEVER       // option value without a bound value, matches nothing
+};
+
+struct PackedNode
+{
+    uint8_t type;       // NodeType
+    uint8_t op;         // PackedOp
+    uint16_t count;     // number of choices
+    uint32_t child;     // index of the first choice
+    int32_t lo;
+    int32_t hi;
+};
+
+static_assert(sizeof(PackedNode) == 16, "PackedNode has to stay 16 bytes");
+
+// Flat breadth first copy of a TreeNode tree. The root is node 0 and the
+// choices of a node are stored next to each other. Everything not needed
+// to step through the tree lives in the parallel arrays. The arrays can be
+// huge page backed, see tree_pages_configure.
+struct CompiledTree
+{
+    TreePageVector<PackedNode> nodes;
+
+    TreePageVector<uint32_t> vars;  // feature of decision/option nodes
+    TreePageVector<uint32_t> names; // symbol id of the node name
+
+    IntervalSet intervals;          // predicates that don't fit into a node
+};
+
+int compiled_tree_build(CompiledTree& tree, const TreeNode& root, SymbolPool& symbols, FeatureSet& features);
+
+// Overwrite the entry at index with src (a choice of a parent_type node) and
+// append everything below src. What was below the old entry stays behind
+// unreachable until the tree is relaid out.
+int compiled_tree_graft(CompiledTree& tree, uint32_t index, const TreeNode& src, NodeType parent_type, SymbolPool& symbols, FeatureSet& features);
+
+// whether var passes the predicate of node, SET predicates index intervals
+bool compiled_tree_match(const PackedNode& node, const DecisionInterval* intervals, int64_t var);
+
+uint32_t compiled_tree_step(const CompiledTree& tree, uint32_t node, int64_t var);
+
+// walk from the root, returns the reached final node or COMPILED_NONE
+uint32_t compiled_tree_eval(const CompiledTree& tree, const int64_t* record);
+
+// Evaluate count records of width values each into results. Up to group
+// records (at most COMPILED_MAX_GROUP) advance through the tree in turns and
+// the next nodes of each are prefetched, so their cache misses overlap.
+// A group of 0 or 1 evaluates one record after another.
+#define COMPILED_MAX_GROUP 32
+
+void compiled_tree_eval_batch(const CompiledTree& tree, const int64_t* records, size_t width, size_t count, uint32_t* results, size_t group);
+
+size_t compiled_tree_bytes(const CompiledTree& tree);
@@ -0,0 +1,618 @@
+#include "louds_tree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static uint32_t louds_first_bit(uint64_t word)
+{
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (uint32_t)index;
+}
+
+static uint32_t louds_popcount(uint64_t word)
+{
+    return (uint32_t)__popcnt64(word);
+}
+
+static uint32_t louds_width(uint64_t value)
+{
+    unsigned long index;
+    return _BitScanReverse64(&index, value) ? (uint32_t)index + 1 : 0;
+}
+#else
+static uint32_t louds_first_bit(uint64_t word)
+{
+    return (uint32_t)__builtin_ctzll(word);
+}
+
+static uint32_t louds_popcount(uint64_t word)
+{
+    return (uint32_t)__builtin_popcountll(word);
+}
+
+static uint32_t louds_width(uint64_t value)
+{
+    return value ? 64 - (uint32_t)__builtin_clzll(value) : 0;
+}
+#endif
+
+#define LOUDS_BLOCK_WORDS (LOUDS_BLOCK_BITS / 64)
+
+// ------------------------------------------------------------------------
+// packed arrays
+// ------------------------------------------------------------------------
+// words for count values, reading the word after the last value stays inside
+static uint64_t louds_array_words(uint64_t count, uint32_t width)
+{
+    return count * width / 64 + 2;
+}
+
+// the bits of index have to be zero
+static void louds_array_set(LoudsArray& array, uint64_t index, uint32_t value)
+{
+    uint64_t bit = index * array.width;
+    uint64_t word = bit / 64;
+    uint32_t shift = bit % 64;
+
+    array.words[word] |= (uint64_t)value << shift;
+    if (shift + array.width > 64)
+        array.words[word + 1] |= (uint64_t)value >> (64 - shift);
+}
+
+static void louds_array_build(LoudsArray& array, const std::vector<uint32_t>& values)
+{
+    uint32_t max = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+    array.width = louds_width(max);
+    array.words.assign(louds_array_words(values.size(), array.width), 0);
+
+    for (size_t i = 0; i < values.size(); ++i)
+        louds_array_set(array, i, values[i]);
+}
+
+static uint32_t louds_array_get(const LoudsArray& array, uint64_t index)
+{
+    uint64_t bit = index * array.width;
+    uint64_t word = bit / 64;
+    uint32_t shift = bit % 64;
+
+    // the padding word makes reading the next word safe, the double shift
+    // keeps a shift of 0 defined
+    uint64_t value = (array.words[word] >> shift) | ((array.words[word + 1] << 1) << (63 - shift));
+    return (uint32_t)(value & ((1ull << array.width) - 1));
+}
+
+// append value as entry index, repacking the first index entries if it is
+// wider than the rest, which happens at most 32 times
+static void louds_array_push(LoudsArray& array, uint64_t index, uint32_t value)
+{
+    uint32_t width = louds_width(value);
+    if (width > array.width)
+    {
+        LoudsArray wider = { width };
+        wider.words.assign(louds_array_words(index, width), 0);
+        for (uint64_t i = 0; i < index; ++i)
+            louds_array_set(wider, i, louds_array_get(array, i));
+        array = std::move(wider);
+    }
+
+    uint64_t words = louds_array_words(index + 1, array.width);
+    if (array.words.size() < words)
+        array.words.resize(words, 0);
+    louds_array_set(array, index, value);
+}
+
+static void louds_array_finish(LoudsArray& array, uint64_t count)
+{
+    array.words.resize(louds_array_words(count, array.width));
+    array.words.shrink_to_fit();
+}
+
+static size_t louds_array_bytes(const LoudsArray& array)
+{
+    return array.words.capacity() * sizeof(uint64_t);
+}
+
+// ------------------------------------------------------------------------
+// building
+// ------------------------------------------------------------------------
+static void louds_build_select(LoudsTree& louds)
+{
+    size_t blocks = louds.bits.size() / LOUDS_BLOCK_WORDS;
+    louds.ranks.resize(blocks + 1);
+    louds.samples.clear();
+
+    uint32_t zeros = 0;
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        louds.ranks[b] = zeros;
+
+        uint32_t block_zeros = 0;
+        for (size_t w = 0; w < LOUDS_BLOCK_WORDS; ++w)
+            block_zeros += louds_popcount(~louds.bits[b * LOUDS_BLOCK_WORDS + w]);
+
+        // every sampled zero that falls into this block
+        uint64_t next = (uint64_t)louds.samples.size() * LOUDS_SELECT_SAMPLE;
+        for (; next < (uint64_t)zeros + block_zeros; next += LOUDS_SELECT_SAMPLE)
+            louds.samples.push_back((uint32_t)b);
+
+        zeros += block_zeros;
+    }
+    louds.ranks[blocks] = zeros;
+    louds.ranks.shrink_to_fit();
+    louds.samples.shrink_to_fit();
+}
+
+void louds_builder_begin(LoudsBuilder& builder, LoudsTree& louds, const IntervalSet& intervals)
+{
+    louds = {};
+    louds.intervals = intervals;
+
+    builder.louds = &louds;
+    builder.table.clear();
+    builder.announced = 1;
+}
+
+int louds_builder_add(LoudsBuilder& builder, const PackedNode& node, uint32_t var, uint32_t name)
+{
+    LoudsTree& louds = *builder.louds;
+    if (louds.count >= builder.announced)
+    {
+        printf("[Error] LOUDS stream has more nodes than choices.\n");
+        return 0;
+    }
+
+    if (builder.announced + node.count >= COMPILED_NONE)
+    {
+        printf("[Error] LOUDS trees are limited to %u nodes.\n", COMPILED_NONE - 1);
+        return 0;
+    }
+
+    if ((PackedOp)node.op == PackedOp::SET && (node.lo < 0 || node.hi < 0 || (uint64_t)node.lo + node.hi > louds.intervals.size()))
+    {
+        printf("[Error] LOUDS node %u has a set outside the intervals.\n", louds.count);
+        return 0;
+    }
+
+    // ones for the choices, then a zero, the words are filled with ones
+    uint64_t bit = louds.size + node.count;
+    if (louds.bits.size() * 64 <= bit)
+        louds.bits.resize(bit / 64 + 1, ~0ull);
+    louds.bits[bit / 64] &= ~(1ull << (bit % 64));
+    louds.size = bit + 1;
+
+    auto [entry, added] = builder.table.try_emplace({ node.op, node.lo, node.hi }, (uint32_t)louds.table.size());
+    if (added) louds.table.push_back({ 0, node.op, 0, 0, node.lo, node.hi });
+
+    NodeType type = (NodeType)node.type;
+    bool has_var = (type == NodeType::DECISION || type == NodeType::OPTION) && var != COMPILED_NONE;
+
+    uint64_t index = louds.count++;
+    louds_array_push(louds.types, index, node.type);
+    louds_array_push(louds.predicates, index, entry->second);
+    louds_array_push(louds.vars, index, has_var ? var + 1 : 0);
+    louds_array_push(louds.names, index, name);
+
+    builder.announced += node.count;
+    return 1;
+}
+
+int louds_builder_end(LoudsBuilder& builder)
+{
+    LoudsTree& louds = *builder.louds;
+    if (louds.count == 0)
+    {
+        printf("[Error] Can't build a LOUDS tree from an empty tree.\n");
+        return 0;
+    }
+
+    if (louds.count != builder.announced)
+    {
+        printf("[Error] LOUDS stream ended after %u of %llu nodes.\n", louds.count, (unsigned long long)builder.announced);
+        return 0;
+    }
+
+    // whole blocks, the bits past the end stay ones
+    uint64_t words = (louds.size + 63) / 64;
+    louds.bits.resize((words + LOUDS_BLOCK_WORDS - 1) / LOUDS_BLOCK_WORDS * LOUDS_BLOCK_WORDS, ~0ull);
+    louds.bits.shrink_to_fit();
+    louds_build_select(louds);
+
+    louds_array_finish(louds.types, louds.count);
+    louds_array_finish(louds.predicates, louds.count);
+    louds_array_finish(louds.vars, louds.count);
+    louds_array_finish(louds.names, louds.count);
+    louds.table.shrink_to_fit();
+
+    builder.table.clear();
+    return 1;
+}
+
+int louds_tree_build(LoudsTree& louds, const CompiledTree& tree)
+{
+    LoudsBuilder builder;
+    louds_builder_begin(builder, louds, tree.intervals);
+    if (tree.nodes.size() == 0) return louds_builder_end(builder);
+
+    // breadth first order, the compiled tree may have been edited
+    std::vector<uint32_t> order = { 0 };
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const PackedNode& node = tree.nodes[order[i]];
+        for (uint32_t c = 0; c < node.count; ++c)
+            order.push_back(node.child + c);
+    }
+
+    for (uint32_t index : order)
+    {
+        if (!louds_builder_add(builder, tree.nodes[index], tree.vars[index], tree.names[index]))
+            return 0;
+    }
+    return louds_builder_end(builder);
+}
+
+// ------------------------------------------------------------------------
+// navigation
+// ------------------------------------------------------------------------
+// position of zero k, counting from 0
+static uint64_t louds_select0(const LoudsTree& louds, uint32_t k)
+{
+    size_t sample = k / LOUDS_SELECT_SAMPLE;
+    size_t first = louds.samples[sample];
+    size_t last = sample + 1 < louds.samples.size() ? louds.samples[sample + 1] : louds.ranks.size() - 2;
+
+    // last block starting with at most k zeros in front of it
+    const uint32_t* ranks = louds.ranks.data();
+    size_t block = std::upper_bound(ranks + first, ranks + last + 1, k) - ranks - 1;
+
+    uint32_t rest = k - ranks[block];
+    const uint64_t* word = louds.bits.data() + block * LOUDS_BLOCK_WORDS;
+    for (uint32_t zeros; rest >= (zeros = louds_popcount(~*word)); ++word)
+        rest -= zeros;
+
+    uint64_t inverted = ~*word;
+    for (; rest; --rest)
+        inverted &= inverted - 1;
+
+    return (uint64_t)(word - louds.bits.data()) * 64 + louds_first_bit(inverted);
+}
+
+// position of the first zero at or after pos
+static uint64_t louds_next0(const LoudsTree& louds, uint64_t pos)
+{
+    uint64_t word = pos / 64;
+    uint64_t inverted = ~louds.bits[word] & (~0ull << (pos % 64));
+    while (!inverted)
+        inverted = ~louds.bits[++word];
+
+    return word * 64 + louds_first_bit(inverted);
+}
+
+uint32_t louds_tree_step(const LoudsTree& louds, uint32_t node, int64_t var)
+{
+    uint64_t start = node == 0 ? 0 : louds_select0(louds, node - 1) + 1;
+    uint64_t end = louds_next0(louds, start);
+
+    // every one in front of start is a node after the root
+    uint64_t first = start - node + 1;
+    for (uint64_t i = first; i < first + (end - start); ++i)
+    {
+        const PackedNode& predicate = louds.table[louds_array_get(louds.predicates, i)];
+        if (compiled_tree_match(predicate, louds.intervals.data(), var))
+            return louds_array_get(louds.types, i) == (uint32_t)NodeType::INVALID ? COMPILED_NONE : (uint32_t)i;
+    }
+
+    return COMPILED_NONE;
+}
+
+uint32_t louds_tree_eval(const LoudsTree& louds, const int64_t* record)
+{
+    uint32_t node = 0;
+    while (node != COMPILED_NONE && louds_array_get(louds.types, node) != (uint32_t)NodeType::FINAL)
+    {
+        uint32_t var = louds_array_get(louds.vars, node);
+        if (var == 0) return COMPILED_NONE;
+
+        node = louds_tree_step(louds, node, record[var - 1]);
+    }
+
+    return node;
+}
+
+NodeType louds_tree_type(const LoudsTree& louds, uint32_t node)
+{
+    return (NodeType)louds_array_get(louds.types, node);
+}
+
+uint32_t louds_tree_name(const LoudsTree& louds, uint32_t node)
+{
+    return louds_array_get(louds.names, node);
+}
+
+// ------------------------------------------------------------------------
+// file
+// ------------------------------------------------------------------------
+#define LOUDS_FILE_VERSION 1
+
+static void louds_write(FILE* file, const void* data, size_t size)
+{
+    if (size) fwrite(data, 1, size, file);
+}
+
+static void louds_write_u32(FILE* file, uint32_t value)
+{
+    louds_write(file, &value, sizeof(value));
+}
+
+static void louds_write_u64(FILE* file, uint64_t value)
+{
+    louds_write(file, &value, sizeof(value));
+}
+
+template<typename T>
+static void louds_write_vector(FILE* file, const std::vector<T>& values)
+{
+    louds_write_u64(file, values.size());
+    louds_write(file, values.data(), values.size() * sizeof(T));
+}
+
+static void louds_write_array(FILE* file, const LoudsArray& array)
+{
+    louds_write_u32(file, array.width);
+    louds_write_vector(file, array.words);
+}
+
+int louds_tree_save(const LoudsTree& louds, const SymbolPool& symbols, const FeatureSet& features, const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        printf("[Error] Failed to open file (%s) for writing.\n", filename);
+        return 0;
+    }
+
+    louds_write(file, "DTLT", 4);
+    louds_write_u32(file, LOUDS_FILE_VERSION);
+    louds_write_u32(file, louds.count);
+    louds_write_u64(file, louds.size);
+    louds_write_vector(file, louds.bits);
+
+    louds_write_array(file, louds.types);
+    louds_write_array(file, louds.predicates);
+    louds_write_array(file, louds.vars);
+    louds_write_array(file, louds.names);
+    louds_write_vector(file, louds.table);
+    louds_write_vector(file, louds.intervals);
+
+    louds_write_u32(file, (uint32_t)features.symbols.size());
+    for (size_t i = 0; i < features.symbols.size(); ++i)
+    {
+        louds_write_u32(file, features.symbols[i]);
+        louds_write_u32(file, (uint32_t)features.types[i]);
+    }
+
+    louds_write_u32(file, (uint32_t)symbols.strings.size());
+    for (const auto& str : symbols.strings)
+    {
+        louds_write_u32(file, (uint32_t)str.size());
+        louds_write(file, str.data(), str.size());
+    }
+
+    bool failed = ferror(file);
+    if (fclose(file) != 0 || failed)
+    {
+        printf("[Error] Failed to write file (%s).\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+static bool louds_read(FILE* file, void* data, size_t size)
+{
+    return size == 0 || fread(data, 1, size, file) == size;
+}
+
+static bool louds_read_u32(FILE* file, uint32_t& value)
+{
+    return louds_read(file, &value, sizeof(value));
+}
+
+static bool louds_read_u64(FILE* file, uint64_t& value)
+{
+    return louds_read(file, &value, sizeof(value));
+}
+
+// the size comes from the file, it has to fit in what is left of it
+template<typename T>
+static bool louds_read_vector(FILE* file, uint64_t left, std::vector<T>& values)
+{
+    uint64_t size;
+    if (!louds_read_u64(file, size) || size > left / sizeof(T)) return false;
+
+    values.resize(size);
+    return louds_read(file, values.data(), size * sizeof(T));
+}
+
+static bool louds_read_array(FILE* file, uint64_t left, uint64_t count, LoudsArray& array)
+{
+    return louds_read_u32(file, array.width) && array.width <= 32
+        && louds_read_vector(file, left, array.words)
+        && array.words.size() >= louds_array_words(count, array.width);
+}
+
+// every value of the first count entries below limit
+static bool louds_array_below(const LoudsArray& array, uint64_t count, uint64_t limit)
+{
+    for (uint64_t i = 0; i < count; ++i)
+        if (louds_array_get(array, i) >= limit) return false;
+    return true;
+}
+
+// A level order degree sequence is a tree if every node but the root was
+// named by a one before its own zero, so stepping always moves down.
+static bool louds_check_shape(const LoudsTree& louds)
+{
+    if (louds.count == 0 || louds.size != 2 * (uint64_t)louds.count - 1
+        || louds.bits.size() % LOUDS_BLOCK_WORDS != 0 || louds.bits.size() * 64 < louds.size)
+        return false;
+
+    uint64_t ones = 0, zeros = 0;
+    for (uint64_t bit = 0; bit < louds.size; ++bit)
+    {
+        if (louds.bits[bit / 64] >> (bit % 64) & 1)
+            ones++;
+        else if (zeros++ > ones)
+            return false;
+    }
+
+    // the rest of the last word and the padding words are ones
+    for (uint64_t bit = louds.size; bit < louds.bits.size() * 64; ++bit)
+        if (!(louds.bits[bit / 64] >> (bit % 64) & 1)) return false;
+
+    return zeros == louds.count;
+}
+
+static int louds_tree_read(LoudsTree& louds, SymbolPool& symbols, FeatureSet& features, FILE* file, uint64_t left)
+{
+    char magic[4];
+    uint32_t version;
+    if (!louds_read(file, magic, 4) || memcmp(magic, "DTLT", 4) != 0
+        || !louds_read_u32(file, version) || version != LOUDS_FILE_VERSION)
+    {
+        printf("[Error] Not a LOUDS tree.\n");
+        return 0;
+    }
+
+    bool ok = louds_read_u32(file, louds.count) && louds_read_u64(file, louds.size)
+        && louds_read_vector(file, left, louds.bits) && louds_check_shape(louds)
+        && louds_read_array(file, left, louds.count, louds.types)
+        && louds_read_array(file, left, louds.count, louds.predicates)
+        && louds_read_array(file, left, louds.count, louds.vars)
+        && louds_read_array(file, left, louds.count, louds.names)
+        && louds_read_vector(file, left, louds.table)
+        && louds_read_vector(file, left, louds.intervals);
+
+    // the saved ids, interned into symbols they may be different
+    std::vector<uint32_t> feature_symbols;
+    std::vector<uint32_t> feature_types;
+    uint32_t count = 0;
+    ok = ok && louds_read_u32(file, count) && count <= left / 8;
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+        uint32_t symbol, type;
+        ok = louds_read_u32(file, symbol) && louds_read_u32(file, type)
+            && (type == (uint32_t)NodeType::DECISION || type == (uint32_t)NodeType::OPTION);
+        feature_symbols.push_back(symbol);
+        feature_types.push_back(type);
+    }
+
+    std::vector<uint32_t> remap;
+    ok = ok && louds_read_u32(file, count) && count <= left / 4;
+    for (uint32_t i = 0; ok && i < count; ++i)
+    {
+        uint32_t size;
+        std::string str;
+        ok = louds_read_u32(file, size) && size <= left;
+        if (ok) str.resize(size);
+        ok = ok && louds_read(file, str.data(), size);
+        if (ok) remap.push_back(symbol_pool_intern(symbols, str));
+    }
+
+    // everything the navigation indexes with has to be in range
+    ok = ok && louds_array_below(louds.types, louds.count, (uint32_t)NodeType::FINAL + 1)
+        && louds_array_below(louds.predicates, louds.count, louds.table.size())
+        && louds_array_below(louds.vars, louds.count, feature_symbols.size() + 1)
+        && louds_array_below(louds.names, louds.count, remap.size());
+
+    for (auto& predicate : louds.table)
+    {
+        if (!ok) break;
+        switch ((PackedOp)predicate.op)
+        {
+        case PackedOp::SET:
+            ok = predicate.lo >= 0 && predicate.hi >= 0 && (uint64_t)predicate.lo + predicate.hi <= louds.intervals.size();
+            break;
+        case PackedOp::SYMBOL:
+            ok = (uint32_t)predicate.lo < remap.size();
+            if (ok) predicate.lo = (int32_t)remap[(uint32_t)predicate.lo];
+            break;
+        default:
+            break;
+        }
+    }
+
+    features = {};
+    for (size_t i = 0; ok && i < feature_symbols.size(); ++i)
+    {
+        ok = feature_symbols[i] < remap.size();
+        if (ok) feature_set_add(features, remap[feature_symbols[i]], (NodeType)feature_types[i]);
+    }
+
+    if (!ok)
+    {
+        printf("[Error] LOUDS tree is truncated or corrupt.\n");
+        return 0;
+    }
+
+    // names only need rewriting if the pool already held other strings
+    bool same = true;
+    for (uint32_t i = 0; i < remap.size(); ++i)
+        same = same && remap[i] == i;
+
+    if (!same)
+    {
+        std::vector<uint32_t> names(louds.count);
+        for (uint32_t i = 0; i < louds.count; ++i)
+            names[i] = remap[louds_array_get(louds.names, i)];
+        louds_array_build(louds.names, names);
+    }
+
+    louds_build_select(louds);
+    return 1;
+}
+
+int louds_tree_load(LoudsTree& louds, SymbolPool& symbols, FeatureSet& features, const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        printf("[Error] Failed to open file (%s).\n", filename);
+        return 0;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    louds = {};
+    int result = louds_tree_read(louds, symbols, features, file, size > 0 ? (uint64_t)size : 0);
+    fclose(file);
+
+    if (!result) louds = {};
+    return result;
+}
+
+// ------------------------------------------------------------------------
+// size
+// ------------------------------------------------------------------------
+size_t louds_tree_topology_bytes(const LoudsTree& louds)
+{
+    return louds.bits.capacity() * sizeof(uint64_t)
+        + louds.ranks.capacity() * sizeof(uint32_t)
+        + louds.samples.capacity() * sizeof(uint32_t);
+}
+
+size_t louds_tree_bytes(const LoudsTree& louds)
+{
+    return sizeof(LoudsTree)
+        + louds_tree_topology_bytes(louds)
+        + louds_array_bytes(louds.types)
+        + louds_array_bytes(louds.predicates)
+        + louds_array_bytes(louds.vars)
+        + louds_array_bytes(louds.names)
+        + louds.table.capacity() * sizeof(PackedNode)
+        + louds.intervals.capacity() * sizeof(DecisionInterval);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+#include <map>
+#include <tuple>
+
+// ------------------------------------------------------------------------
+// LOUDS tree
+// ------------------------------------------------------------------------
+// Succinct copy of a CompiledTree for trees too big for 16 byte nodes.
+// The shape is a level order unary degree sequence: every node in breadth
+// first order writes a one per choice followed by a zero, about 2 bits per
+// node. Node i is the i-th run of ones, its first choice is the node after
+// the ones before that run, so stepping only needs select on the zeros.
+// select0 samples every LOUDS_SELECT_SAMPLE-th zero and keeps the zeros in
+// front of every 512 bit block, which adds about 0.2 bits per node.
+//
+// Everything else is bit packed to the width of its largest value. The
+// predicates are deduplicated into a table, so a node only stores an index.
+// Node ids follow the breadth first order, which is the order of a tree fresh
+// from compiled_tree_build, so for those the ids match the compiled ones.
+//
+// Trees too big to ever exist as TreeNodes or a CompiledTree are streamed
+// into a LoudsBuilder node by node and saved, serving then only loads the
+// LOUDS file.
+#define LOUDS_BLOCK_BITS 512
+#define LOUDS_SELECT_SAMPLE 4096
+
+struct LoudsArray
+{
+    uint32_t width;
+    std::vector<uint64_t> words;    // padding at the back
+};
+
+struct LoudsTree
+{
+    std::vector<uint64_t> bits;     // degree sequence, ones past the end
+    uint64_t size;                  // number of bits used
+
+    std::vector<uint32_t> ranks;    // zeros in front of every block
+    std::vector<uint32_t> samples;  // block of every LOUDS_SELECT_SAMPLE-th zero
+
+    LoudsArray types;               // NodeType
+    LoudsArray predicates;          // index into table
+    LoudsArray vars;                // feature + 1, 0 for nodes without one
+    LoudsArray names;               // symbol id of the node name
+
+    std::vector<PackedNode> table;  // only op, lo and hi are used
+    IntervalSet intervals;
+
+    uint32_t count;                 // number of nodes
+};
+
+int louds_tree_build(LoudsTree& louds, const CompiledTree& tree);
+
+// ------------------------------------------------------------------------
+// streaming build
+// ------------------------------------------------------------------------
+// Takes the nodes one by one in breadth first order. A node is a PackedNode
+// (count is its number of choices, child is ignored) with its feature, or
+// COMPILED_NONE, and the symbol id of its name. SET predicates index the
+// intervals passed to begin. The packed arrays are widened as larger values
+// arrive, so building needs little more than the finished tree.
+struct LoudsBuilder
+{
+    LoudsTree* louds;
+    std::map<std::tuple<uint8_t, int32_t, int32_t>, uint32_t> table;
+    uint64_t announced;     // nodes named by the choices so far, with the root
+};
+
+void louds_builder_begin(LoudsBuilder& builder, LoudsTree& louds, const IntervalSet& intervals);
+int louds_builder_add(LoudsBuilder& builder, const PackedNode& node, uint32_t var, uint32_t name);
+
+// fails unless every announced choice was added
+int louds_builder_end(LoudsBuilder& builder);
+
+// ------------------------------------------------------------------------
+// file
+// ------------------------------------------------------------------------
+// Binary (host byte order): "DTLT", u32 version, u32 count, u64 size, the
+// bits, the types, predicates, vars and names arrays as u32 width + words,
+// the table and intervals, then u32 features + (u32 symbol, u32 type) and
+// u32 symbols + (u32 length, bytes). Vectors are u64 size + data. The whole
+// symbol pool is saved. Loading interns the symbols into symbols, remapping
+// the ids if it already held others, replaces features, rebuilds the select
+// samples and checks everything stepping relies on.
+int louds_tree_save(const LoudsTree& louds, const SymbolPool& symbols, const FeatureSet& features, const char* filename);
+int louds_tree_load(LoudsTree& louds, SymbolPool& symbols, FeatureSet& features, const char* filename);
+
+uint32_t louds_tree_step(const LoudsTree& louds, uint32_t node, int64_t var);
+
+// walk from the root, returns the reached final node or COMPILED_NONE
+uint32_t louds_tree_eval(const LoudsTree& louds, const int64_t* record);
+
+NodeType louds_tree_type(const LoudsTree& louds, uint32_t node);
+uint32_t louds_tree_name(const LoudsTree& louds, uint32_t node);
+
+size_t louds_tree_bytes(const LoudsTree& louds);
+
+// bytes of the shape alone: the bits, ranks and samples
+size_t louds_tree_topology_bytes(const LoudsTree& louds);
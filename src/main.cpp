@@ -1,5 +1,15 @@
 #include "tree.h"
 #include "tree_walker.h"
+#include "tree_server.h"
+#include "benchmark.h"
+#include "tree_train.h"
+#include "tree_test.h"
+#include "tree_table.h"
+#include "tree_delta.h"
+#include "tree_memory.h"
+
+#include <filesystem>
+#include <thread>
 
 const char* get_op_name(DecisionOp type)
 {
@@ -13,6 +23,7 @@ const char* get_op_name(DecisionOp type)
     case DecisionOp::LT:      return "<";
     case DecisionOp::LTEQ:    return "<=";
     case DecisionOp::BETWEEN: return "between";
+    case DecisionOp::SET:     return "set";
     }
     return "";
 }
@@ -23,7 +34,11 @@ void print_node(const TreeNode& node, int level = 0)
     printf("Node: %s (%d)", node.name.c_str(), node.type);
 
     if (auto expr = std::get_if<DecisionExpr>(&node.value))
-        printf(" - value: %s | %d;%d", get_op_name(expr->op), expr->value, expr->value2);
+    {
+        printf(" - value: %s | %lld;%lld", get_op_name(expr->op), (long long)expr->value, (long long)expr->value2);
+        for (const auto& i : expr->set)
+            printf(" [%lld:%lld]", (long long)i.lo, (long long)i.hi);
+    }
     else
         printf(" - value: %s", std::get<std::string>(node.value).c_str());
 
@@ -32,82 +47,249 @@ void print_node(const TreeNode& node, int level = 0)
         print_node(choice, level + 2);
 }
 
-void test_tree(const TreeWalker& walker, std::vector<const char*> answers, const char* expected)
+// serve all trees given on the command line, the tree id is the file name without extension
+int serve(const char* address, char** filenames, int count)
 {
-    printf("Testing: ");
-    for (auto answer : answers)
-        printf("\"%s\" ", answer);
-
-    putchar('\n');
-
-    const TreeNode* node = &walker.root;
-    for (auto answer : answers)
+    std::vector<TreeHandle> handles(count);
+    TreeServerTrees trees;
+    for (int i = 0; i < count; ++i)
     {
-        if (node->type == NodeType::FINAL)
+        if (!tree_handle_open(handles[i], filenames[i]))
         {
-            printf("[Warn] Reached final node before asking all questions.\n");
-            break;
+            for (int j = 0; j < i; ++j)
+                tree_handle_close(handles[j]);
+            return -1;
         }
 
-        if (node->type == NodeType::OPTION)
-            node = decision_tree_step(node, answer);
-        else if (node->type == NodeType::DECISION)
-            node = decision_tree_step(node, std::stoi(answer));
+        tree_server_add(trees, std::filesystem::path(filenames[i]).stem().string(), &handles[i]);
     }
 
-    if (!node)
+    // watchers only start once every tree loaded
+    for (auto& handle : handles)
+        tree_handle_watch(handle, 1000);
+
+    int result = tree_server_run(trees, address);
+
+    for (auto& handle : handles)
+        tree_handle_close(handle);
+
+    return result ? 0 : -1;
+}
+
+// learn a tree from a labeled csv file and save it
+int train(const char* data, const char* label, const char* filename)
+{
+    TreeWalker walker;
+    TreeTrainOptions options;
+    if (!tree_train_csv(walker, data, label, options))
+        return -1;
+
+    return tree_walker_save(walker, filename) ? 0 : -1;
+}
+
+// export every path of a tree as decision table, binary unless the file ends in .csv
+int table(const char* filename, const char* out)
+{
+    TreeWalker walker;
+    if (!tree_walker_load(walker, filename, TreeWalkerText::NONE))
+        return -1;
+
+    std::string extension = std::filesystem::path(out).extension().string();
+    TreeTableFormat format = extension == ".csv" ? TreeTableFormat::CSV : TreeTableFormat::BINARY;
+
+    FILE* file = fopen(out, format == TreeTableFormat::CSV ? "w" : "wb");
+    if (!file)
     {
-        if (expected) printf("[Error] Node is null.\n");
-        else          printf("[Success] Reached null.\n");
-        return;
+        printf("[Error] Failed to open file (%s).\n", out);
+        return -1;
     }
 
-    if (node->type != NodeType::FINAL)
+    TreeTableStats stats;
+    int result = tree_table_export(walker.root, file, format, &stats);
+    fclose(file);
+
+    printf("%zu rows, %zu unreachable choices\n", stats.rows, stats.pruned);
+    return result ? 0 : -1;
+}
+
+// write the delta between two versions of a tree
+int diff(const char* from_filename, const char* to_filename, const char* out)
+{
+    TreeWalker from, to;
+    if (!tree_walker_load(from, from_filename) || !tree_walker_load(to, to_filename))
+        return -1;
+
+    TreeDelta delta = tree_delta_diff(from, to);
+
+    FILE* file = fopen(out, "wb");
+    if (!file)
     {
-        printf("[Warn] Reached non node after asking all questions.\n");
+        printf("[Error] Failed to open file (%s).\n", out);
+        return -1;
     }
 
-    if (node->name.compare(expected) == 0)
-        printf("[Success] Reached expected node (%s).\n", node->name.c_str());
-    else
-        printf("[Failed] Reached node: %s, expected: %s.\n", node->name.c_str(), expected);
+    int result = tree_delta_write(delta, file);
+    printf("%zu entries, %zu texts, %ld bytes\n", delta.entries.size(), delta.texts.size(), ftell(file));
+    fclose(file);
+
+    return result ? 0 : -1;
 }
 
-void run_tests(const TreeWalker& walker)
+// apply a delta to a tree and save the result
+int patch(const char* filename, const char* delta_filename, const char* out)
 {
-    printf("===============================================\n");
-    printf("| Decision Tree:                              |\n");
-    printf("===============================================\n");
-    print_node(walker.root);
-    putchar('\n');
-    printf("===============================================\n");
-    printf("| Tests:                                      |\n");
-    printf("===============================================\n");
-
-    test_tree(walker, { "sunny", "10" }, "walk");
-    test_tree(walker, { "sunny", "-10" }, nullptr);
-    test_tree(walker, { "sunny", "200" }, "bus");
-    test_tree(walker, { "cloudy", "yes" }, "walk");
-    test_tree(walker, { "rainy" }, "bus");
+    TreeWalker walker;
+    if (!tree_walker_load(walker, filename))
+        return -1;
+
+    FILE* file = fopen(delta_filename, "rb");
+    if (!file)
+    {
+        printf("[Error] Failed to open file (%s).\n", delta_filename);
+        return -1;
+    }
+
+    TreeDelta delta;
+    int result = tree_delta_read(delta, file);
+    fclose(file);
+
+    if (!result || !tree_delta_apply(walker, delta))
+        return -1;
+
+    return tree_walker_save(walker, out) ? 0 : -1;
 }
 
-// #define RUN_TESTS
+// print the memory used by each tree and by all of them together
+int memory(char** filenames, int count)
+{
+    TreeMemory all = {};
+    for (int i = 0; i < count; ++i)
+    {
+        TreeMemory memory = {};
+        TreeWalker walker;
+        if (!tree_memory_load(memory, walker, filenames[i]))
+            return -1;
+
+        printf("%s:\n", filenames[i]);
+        tree_memory_print(memory);
+
+        for (size_t p = 0; p < (size_t)TreeMemoryPart::COUNT; ++p)
+        {
+            all.parts[p].bytes += memory.parts[p].bytes;
+            all.parts[p].heap += memory.parts[p].heap;
+            all.parts[p].allocations += memory.parts[p].allocations;
+        }
+    }
+
+    if (count > 1)
+    {
+        printf("all %d trees:\n", count);
+        tree_memory_print(all);
+    }
+    return 0;
+}
+
+// train a tree from a csv file, the label is the last column
+int train_last_column(TreeWalker& walker, const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        printf("[Error] Failed to open file (%s).\n", filename);
+        return 0;
+    }
+
+    char header[4096] = "";
+    if (!fgets(header, sizeof(header), file)) header[0] = '\0';
+    fclose(file);
+
+    std::string label = header;
+    label.erase(label.find_last_not_of("\r\n") + 1);
+    label.erase(0, label.rfind(',') + 1);
+
+    TreeTrainOptions options;
+    return tree_train_csv(walker, filename, label.c_str(), options);
+}
+
+// run the cases of a case file against a tree, or against the tree trained from a csv file
+int test(const char* filename, const char* cases_filename, size_t threads)
+{
+    TreeWalker walker;
+    if (std::filesystem::path(filename).extension() == ".csv")
+    {
+        if (!train_last_column(walker, filename))
+            return -1;
+    }
+    else if (!tree_walker_load(walker, filename, TreeWalkerText::NONE))
+        return -1;
+
+    std::vector<TreeTestCase> cases;
+    if (!tree_test_load(cases, cases_filename))
+        return -1;
+
+    TreeTestReport report = tree_test_run(walker, cases, threads, 20);
+    printf("%zu passed, %zu failed (%zu threads, %.3f s, %.1f M cases/s)\n", report.passed, report.failed,
+        report.threads, report.seconds, report.seconds > 0 ? cases.size() / report.seconds / 1e6 : 0.0);
+
+    return report.failed ? 1 : 0;
+}
 
 int main(int argc, char* argv[])
 {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        run_benchmarks();
+        return 0;
+    }
+
+    // usage: DecisionTree --serve <socket path | tcp:port> <file>...
+    if (argc > 3 && strcmp(argv[1], "--serve") == 0)
+        return serve(argv[2], argv + 3, argc - 3);
+
+    // usage: DecisionTree --train <data.csv> <label column> <out.xml>
+    if (argc > 4 && strcmp(argv[1], "--train") == 0)
+        return train(argv[2], argv[3], argv[4]);
+
+    // usage: DecisionTree --test <tree.xml | data.csv> <cases> [threads]
+    if (argc > 3 && strcmp(argv[1], "--test") == 0)
+        return test(argv[2], argv[3], argc > 4 ? (size_t)atoi(argv[4]) : std::thread::hardware_concurrency());
+
+    // usage: DecisionTree --table <tree.xml> <out.csv | out.bin>
+    if (argc > 3 && strcmp(argv[1], "--table") == 0)
+        return table(argv[2], argv[3]);
+
+    // usage: DecisionTree --diff <old.xml> <new.xml> <out.delta>
+    if (argc > 4 && strcmp(argv[1], "--diff") == 0)
+        return diff(argv[2], argv[3], argv[4]);
+
+    // usage: DecisionTree --patch <tree.xml> <delta> <out.xml>
+    if (argc > 4 && strcmp(argv[1], "--patch") == 0)
+        return patch(argv[2], argv[3], argv[4]);
+
+    // usage: DecisionTree --memory <tree.xml>...
+    if (argc > 2 && strcmp(argv[1], "--memory") == 0)
+        return memory(argv + 2, argc - 2);
+
+    // usage: DecisionTree --print <tree.xml>
+    if (argc > 2 && strcmp(argv[1], "--print") == 0)
+    {
+        TreeWalker walker;
+        if (!tree_walker_load(walker, argv[2], TreeWalkerText::NONE))
+            return -1;
+
+        print_node(walker.root);
+        return 0;
+    }
+
     const char* filename = argc > 1 ? argv[1] : "res/tree.xml";
 
     TreeWalker walker;
     if (!tree_walker_load(walker, filename))
         return -1;
 
-#ifdef RUN_TESTS
-    run_tests(walker);
-#else
     tree_walker_show_intro(walker);
     auto result = tree_walker_run(walker);
     tree_walker_show_result(walker, result);
-#endif
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+#include "symbol_pool.h"
+
+uint32_t symbol_pool_intern(SymbolPool& pool, std::string_view str)
+{
+    auto found = pool.ids.find(str);
+    if (found != pool.ids.end()) return found->second;
+
+    uint32_t id = (uint32_t)pool.strings.size();
+    pool.strings.emplace_back(str);
+    pool.ids.emplace(pool.strings.back(), id);
+    return id;
+}
+
+uint32_t symbol_pool_find(const SymbolPool& pool, std::string_view str)
+{
+    auto found = pool.ids.find(str);
+    return found != pool.ids.end() ? found->second : SYMBOL_NONE;
+}
+
+std::string_view symbol_pool_get(const SymbolPool& pool, uint32_t id)
+{
+    if (id >= pool.strings.size()) return {};
+    return pool.strings[id];
+}
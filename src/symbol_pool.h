@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// ------------------------------------------------------------------------
+// symbol pool
+// ------------------------------------------------------------------------
+// Interns strings to dense ids. Interned strings never move, so the views
+// handed out stay valid for the lifetime of the pool.
+#define SYMBOL_NONE UINT32_MAX
+
+struct SymbolPool
+{
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+uint32_t symbol_pool_intern(SymbolPool& pool, std::string_view str);
+uint32_t symbol_pool_find(const SymbolPool& pool, std::string_view str);
+
+std::string_view symbol_pool_get(const SymbolPool& pool, uint32_t id);
@@ -1,6 +1,9 @@
 #include "tree.h"
 
-bool decision_expr_eval(const DecisionExpr* expr, int var)
+#include <algorithm>
+#include <charconv>
+
+bool decision_expr_eval(const DecisionExpr* expr, int64_t var)
 {
     switch (expr->op)
     {
@@ -12,11 +15,173 @@ bool decision_expr_eval(const DecisionExpr* expr, int var)
     case DecisionOp::LTEQ:  return var <= expr->value;
     case DecisionOp::BETWEEN:
         return expr->value <= var && var <= expr->value2;
+    case DecisionOp::SET:
+        return interval_set_contains(expr->set, var);
+    case DecisionOp::UNKNOWN:
+        break;
     }
     return false;
 }
 
-const TreeNode* decision_tree_step(const TreeNode* node, int var)
+IntervalSet decision_expr_intervals(const DecisionExpr& expr)
+{
+    const int64_t min = INT64_MIN;
+    const int64_t max = INT64_MAX;
+    const int64_t v = expr.value;
+
+    switch (expr.op)
+    {
+    case DecisionOp::EQ:    return { { v, v } };
+    case DecisionOp::NOTEQ: return interval_set_complement({ { v, v } });
+    case DecisionOp::GT:    return v == max ? IntervalSet() : IntervalSet{ { v + 1, max } };
+    case DecisionOp::GTEQ:  return { { v, max } };
+    case DecisionOp::LT:    return v == min ? IntervalSet() : IntervalSet{ { min, v - 1 } };
+    case DecisionOp::LTEQ:  return { { min, v } };
+    case DecisionOp::BETWEEN:
+        return v <= expr.value2 ? IntervalSet{ { v, expr.value2 } } : IntervalSet();
+    case DecisionOp::SET:
+        return expr.set;
+    case DecisionOp::UNKNOWN:
+        break;
+    }
+    return {};
+}
+
+DecisionExpr decision_expr_from_intervals(IntervalSet set)
+{
+    interval_set_normalize(set);
+
+    if (set.size() == 1)
+    {
+        auto i = set[0];
+        if (i.lo == i.hi)       return { DecisionOp::EQ, i.lo };
+        if (i.lo == INT64_MIN)  return { DecisionOp::LTEQ, i.hi };
+        if (i.hi == INT64_MAX)  return { DecisionOp::GTEQ, i.lo };
+        return { DecisionOp::BETWEEN, i.lo, i.hi };
+    }
+
+    if (set.size() == 2 && set[0].lo == INT64_MIN && set[1].hi == INT64_MAX && set[0].hi + 2 == set[1].lo)
+        return { DecisionOp::NOTEQ, set[0].hi + 1 };
+
+    return { DecisionOp::SET, 0, 0, set };
+}
+
+static std::string decision_interval_format(const DecisionInterval& i)
+{
+    if (i.lo == i.hi)       return std::to_string(i.lo);
+    if (i.lo == INT64_MIN)  return "<=" + std::to_string(i.hi);
+    if (i.hi == INT64_MAX)  return ">=" + std::to_string(i.lo);
+    return std::to_string(i.lo) + ":" + std::to_string(i.hi);
+}
+
+std::string decision_expr_format(const DecisionExpr& expr)
+{
+    std::string v = std::to_string(expr.value);
+    switch (expr.op)
+    {
+    case DecisionOp::EQ:      return v;
+    case DecisionOp::NOTEQ:   return "!=" + v;
+    case DecisionOp::GT:      return ">" + v;
+    case DecisionOp::GTEQ:    return ">=" + v;
+    case DecisionOp::LT:      return "<" + v;
+    case DecisionOp::LTEQ:    return "<=" + v;
+    case DecisionOp::BETWEEN: return v + ":" + std::to_string(expr.value2);
+    case DecisionOp::SET:
+    {
+        // nothing is less than INT64_MIN, so that is the empty set
+        if (expr.set.empty()) return "<" + std::to_string(INT64_MIN);
+
+        std::string str;
+        for (const auto& i : expr.set)
+        {
+            if (!str.empty()) str += " | ";
+            str += decision_interval_format(i);
+        }
+        return str;
+    }
+    case DecisionOp::UNKNOWN:
+        break;
+    }
+    return "";
+}
+
+// ------------------------------------------------------------------------
+// interval sets
+// ------------------------------------------------------------------------
+void interval_set_normalize(IntervalSet& set)
+{
+    set.erase(std::remove_if(set.begin(), set.end(), [](const DecisionInterval& i) { return i.lo > i.hi; }), set.end());
+    std::sort(set.begin(), set.end(), [](const DecisionInterval& a, const DecisionInterval& b) { return a.lo < b.lo; });
+
+    // merge overlapping and adjacent intervals
+    size_t count = 0;
+    for (const auto& i : set)
+    {
+        if (count > 0 && set[count - 1].hi != INT64_MAX && i.lo <= set[count - 1].hi + 1)
+            set[count - 1].hi = std::max(set[count - 1].hi, i.hi);
+        else if (count > 0 && set[count - 1].hi == INT64_MAX)
+            continue;
+        else
+            set[count++] = i;
+    }
+    set.resize(count);
+}
+
+IntervalSet interval_set_union(const IntervalSet& a, const IntervalSet& b)
+{
+    IntervalSet set = a;
+    set.insert(set.end(), b.begin(), b.end());
+    interval_set_normalize(set);
+    return set;
+}
+
+IntervalSet interval_set_intersect(const IntervalSet& a, const IntervalSet& b)
+{
+    IntervalSet set;
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        int64_t lo = std::max(a[i].lo, b[j].lo);
+        int64_t hi = std::min(a[i].hi, b[j].hi);
+        if (lo <= hi) set.push_back({ lo, hi });
+
+        if (a[i].hi < b[j].hi) i++;
+        else                   j++;
+    }
+    return set;
+}
+
+IntervalSet interval_set_complement(const IntervalSet& set)
+{
+    IntervalSet result;
+    int64_t lo = INT64_MIN;
+    for (const auto& i : set)
+    {
+        if (i.lo > lo) result.push_back({ lo, i.lo - 1 });
+        if (i.hi == INT64_MAX) return result;
+        lo = i.hi + 1;
+    }
+    result.push_back({ lo, INT64_MAX });
+    return result;
+}
+
+bool interval_set_contains(const IntervalSet& set, int64_t var)
+{
+    // small sets are checked without branches, larger ones by binary search
+    if (set.size() <= 8)
+    {
+        bool hit = false;
+        for (const auto& i : set)
+            hit |= (i.lo <= var) & (var <= i.hi);
+        return hit;
+    }
+
+    auto next = std::upper_bound(set.begin(), set.end(), var,
+        [](int64_t v, const DecisionInterval& i) { return v < i.lo; });
+    return next != set.begin() && var <= (next - 1)->hi;
+}
+
+const TreeNode* decision_tree_step(const TreeNode* node, int64_t var)
 {
     if (node->type != NodeType::DECISION) return nullptr;
 
@@ -32,7 +197,7 @@ const TreeNode* decision_tree_step(const TreeNode* node, int var)
     return nullptr;
 }
 
-const TreeNode* decision_tree_step(const TreeNode* node, const std::string& var)
+const TreeNode* decision_tree_step(const TreeNode* node, std::string_view var)
 {
     if (node->type != NodeType::OPTION) return nullptr;
 
@@ -48,6 +213,45 @@ const TreeNode* decision_tree_step(const TreeNode* node, const std::string& var)
     return nullptr;
 }
 
+const TreeNode* decision_tree_walk(const TreeNode* node, const std::string_view* answers, size_t count)
+{
+    for (size_t i = 0; node && i < count; ++i)
+    {
+        if (node->type == NodeType::FINAL) break;
+
+        if (node->type == NodeType::OPTION)
+        {
+            node = decision_tree_step(node, answers[i]);
+        }
+        else if (node->type == NodeType::DECISION)
+        {
+            int64_t val = 0;
+            auto end = answers[i].data() + answers[i].size();
+            auto res = std::from_chars(answers[i].data(), end, val);
+            if (res.ec != std::errc() || res.ptr != end) return nullptr;
+
+            node = decision_tree_step(node, val);
+        }
+    }
+    return node;
+}
+
+size_t tree_node_bytes(const TreeNode& node)
+{
+    // strings within the small string buffer don't allocate
+    size_t bytes = sizeof(TreeNode) + (node.choices.capacity() - node.choices.size()) * sizeof(TreeNode);
+    bytes += node.name.capacity() > 15 ? node.name.capacity() + 1 : 0;
+
+    if (auto str = std::get_if<std::string>(&node.value))
+        bytes += str->capacity() > 15 ? str->capacity() + 1 : 0;
+    else if (auto expr = std::get_if<DecisionExpr>(&node.value))
+        bytes += expr->set.capacity() * sizeof(DecisionInterval);
+
+    for (const auto& choice : node.choices)
+        bytes += tree_node_bytes(choice);
+
+    return bytes;
+}
 
 // ------------------------------------------------------------------------
 // basic parsing
@@ -76,6 +280,8 @@ enum class TokenType
     GT, GTEQ,
     LT, LTEQ,
     BETWEEN,
+    OR, AND,
+    LBRACE, RBRACE, COMMA
 };
 
 struct Token
@@ -93,6 +299,8 @@ static const char* next_token(Token& token, const char* cursor)
     if (*cursor == c2) { token.type = t2; cursor++; } \
     break;
 
+    while (*cursor == ' ') cursor++;
+
     token.type = TokenType::UNKNOWN;
     token.start = cursor;
     token.end = nullptr;
@@ -105,6 +313,10 @@ static const char* next_token(Token& token, const char* cursor)
 
     switch (*(cursor++))
     {
+    case '-':
+        // negative numbers, the sign has to be followed by a digit
+        if (*cursor < '0' || *cursor > '9') break;
+        [[fallthrough]];
     case '0': case '1': case '2': case '3': case '4':
     case '5': case '6': case '7': case '8': case '9':
     {
@@ -117,6 +329,11 @@ static const char* next_token(Token& token, const char* cursor)
     TOKEN_CASE2('<', TokenType::LT, '=', TokenType::LTEQ)
     TOKEN_CASE2('>', TokenType::GT, '=', TokenType::GTEQ)
     TOKEN_CASE2('!', TokenType::UNKNOWN, '=', TokenType::NOTEQ)
+    TOKEN_CASE2('|', TokenType::OR, '|', TokenType::OR)
+    TOKEN_CASE2('&', TokenType::AND, '&', TokenType::AND)
+    TOKEN_CASE1('{', TokenType::LBRACE)
+    TOKEN_CASE1('}', TokenType::RBRACE)
+    TOKEN_CASE1(',', TokenType::COMMA)
     }
 
     token.end = cursor;
@@ -133,66 +350,162 @@ static DecisionOp to_decision_op(TokenType type)
     return DecisionOp::UNKNOWN;
 }
 
-static int token_to_int(const Token& t)
+// parses the token span in place, fails on overflow instead of throwing
+static bool token_to_int(const Token& t, int64_t& value)
 {
-    return std::stoi(std::string(t.start, t.end - t.start));
+    auto result = std::from_chars(t.start, t.end, value);
+    return result.ec == std::errc() && result.ptr == t.end;
 }
 
-static DecisionExpr parse_decision_expr(const char* str)
+// Grammar of the value attribute of decision choices:
+//
+//   expr    = term { '|' term }
+//   term    = factor { '&' factor }
+//   factor  = NUMBER                   (EQ shortcut)
+//           | NUMBER ':' NUMBER        (BETWEEN)
+//           | op NUMBER                (=, !=, >, >=, <, <=)
+//           | '{' NUMBER { ',' NUMBER } '}'
+//
+// '||' and '&&' are accepted as well. Compound expressions are normalized
+// into a single sorted interval set at load time.
+struct ExprParser
 {
-    if (!str) return { DecisionOp::UNKNOWN, 0 };
-
     Token token;
-    const char* cursor = next_token(token, str);
-    if (token.type == TokenType::UNKNOWN) return { DecisionOp::UNKNOWN, 0 };
+    const char* cursor;
+    const char* error;
+};
+
+static const char* EXPR_UNKNOWN_OP = "Unkown operation.";
+static const char* EXPR_OUT_OF_RANGE = "Value out of range.";
+
+static void expr_next(ExprParser& p)
+{
+    p.cursor = next_token(p.token, p.cursor);
+}
+
+static bool expr_fail(ExprParser& p, const char* error)
+{
+    p.error = error;
+    return false;
+}
+
+static bool expr_number(ExprParser& p, int64_t& value)
+{
+    if (p.token.type != TokenType::NUMBER) return expr_fail(p, EXPR_UNKNOWN_OP);
+    if (!token_to_int(p.token, value))     return expr_fail(p, EXPR_OUT_OF_RANGE);
+
+    expr_next(p);
+    return true;
+}
+
+static bool parse_expr_factor(ExprParser& p, DecisionExpr& expr)
+{
+    // set literal
+    if (p.token.type == TokenType::LBRACE)
+    {
+        IntervalSet set;
+        do
+        {
+            expr_next(p);
 
-    int value = 0;
-    TokenType type = token.type;
+            int64_t value = 0;
+            if (!expr_number(p, value)) return false;
+            set.push_back({ value, value });
+        }
+        while (p.token.type == TokenType::COMMA);
 
-    if (token.type == TokenType::NUMBER)
-        value = token_to_int(token);
+        if (p.token.type != TokenType::RBRACE) return expr_fail(p, EXPR_UNKNOWN_OP);
+        expr_next(p);
 
-    cursor = next_token(token, cursor);
-    if (token.type == TokenType::UNKNOWN) return { DecisionOp::UNKNOWN, 0 };
+        expr = decision_expr_from_intervals(set);
+        return true;
+    }
 
-    // parse EQUAL (EQ) shortcut:
-    //  - first and only token has to be NUMBER
-    if (token.type == TokenType::END)
+    // EQ shortcut and BETWEEN
+    if (p.token.type == TokenType::NUMBER)
     {
-        if (type == TokenType::NUMBER)  return { DecisionOp::EQ, value };
-        else                            return { DecisionOp::UNKNOWN, 0 };
+        int64_t value = 0;
+        if (!expr_number(p, value)) return false;
+
+        if (p.token.type != TokenType::BETWEEN)
+        {
+            expr = { DecisionOp::EQ, value };
+            return true;
+        }
+
+        expr_next(p);
+
+        int64_t value2 = 0;
+        if (!expr_number(p, value2)) return false;
+
+        expr = { DecisionOp::BETWEEN, value, value2 };
+        return true;
     }
 
-    // parse BETWEEN expression: 
-    //  - first token has to be NUMBER token
-    //  - second token has to be BETWEEN token
-    //  - third (and last) token has to be NUMBER token
-    if (token.type == TokenType::BETWEEN)
+    // basic expressions
+    DecisionOp op = to_decision_op(p.token.type);
+    if (op == DecisionOp::UNKNOWN || op == DecisionOp::BETWEEN) return expr_fail(p, EXPR_UNKNOWN_OP);
+
+    expr_next(p);
+
+    int64_t value = 0;
+    if (!expr_number(p, value)) return false;
+
+    expr = { op, value };
+    return true;
+}
+
+static bool parse_expr_term(ExprParser& p, DecisionExpr& expr)
+{
+    if (!parse_expr_factor(p, expr)) return false;
+
+    while (p.token.type == TokenType::AND)
     {
-        cursor = next_token(token, cursor);
-        if (token.type != TokenType::NUMBER) return { DecisionOp::UNKNOWN, 0 };
+        expr_next(p);
 
-        int value2 = token_to_int(token);
-        type = TokenType::BETWEEN;
+        DecisionExpr rhs;
+        if (!parse_expr_factor(p, rhs)) return false;
 
-        cursor = next_token(token, cursor);
-        if (token.type == TokenType::END)   return { DecisionOp::BETWEEN, value, value2 };
-        else                                return { DecisionOp::UNKNOWN, 0 };
+        expr = decision_expr_from_intervals(interval_set_intersect(decision_expr_intervals(expr), decision_expr_intervals(rhs)));
     }
+    return true;
+}
+
+static bool parse_expr(ExprParser& p, DecisionExpr& expr)
+{
+    if (!parse_expr_term(p, expr)) return false;
 
-    // parse basic expressions:
-    //  - first token define operation
-    //  - second (and last) token has to be NUMBER token
-    if (token.type == TokenType::NUMBER)
+    while (p.token.type == TokenType::OR)
     {
-        value = token_to_int(token);
+        expr_next(p);
+
+        DecisionExpr rhs;
+        if (!parse_expr_term(p, rhs)) return false;
 
-        cursor = next_token(token, cursor);
-        if (token.type == TokenType::END)   return { to_decision_op(type), value };
-        else                                return { DecisionOp::UNKNOWN, 0 };
+        expr = decision_expr_from_intervals(interval_set_union(decision_expr_intervals(expr), decision_expr_intervals(rhs)));
     }
+    return true;
+}
+
+static DecisionExpr parse_decision_expr(const char* str, const char** error)
+{
+    *error = EXPR_UNKNOWN_OP;
+    if (!str) return { DecisionOp::UNKNOWN, 0 };
+
+    ExprParser p = { {}, str, nullptr };
+    expr_next(p);
+
+    DecisionExpr expr;
+    if (!parse_expr(p, expr))
+    {
+        *error = p.error;
+        return { DecisionOp::UNKNOWN, 0 };
+    }
+
+    // the whole attribute has to be consumed
+    if (p.token.type != TokenType::END) return { DecisionOp::UNKNOWN, 0 };
 
-    return { DecisionOp::UNKNOWN, 0 };
+    return expr;
 }
 
 // ------------------------------------------------------------------------
@@ -229,11 +542,12 @@ TreeNode parse_tree_node(tinyxml2::XMLElement* element, NodeType parent_type)
     if (parent_type == NodeType::DECISION)
     {
         // parent_type DECISION only allows expr as values
-        auto expr = parse_decision_expr(element->Attribute("value"));
+        const char* error = nullptr;
+        auto expr = parse_decision_expr(element->Attribute("value"), &error);
         if (expr.op == DecisionOp::UNKNOWN)
         {
             printf("[warn] Dropped node %s (%d): ", name, type);
-            printf("Unkown operation.\n");
+            printf("%s\n", error);
             return { NodeType::UNKNOWN };
         }
         value = expr;
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
@@ -15,17 +17,49 @@ enum class DecisionOp
     EQ = 10, NOTEQ,
     GT,      GTEQ,
     LT,      LTEQ,
-    BETWEEN
+    BETWEEN,
+    SET
 };
 
+// inclusive range, sets are kept sorted and merged
+struct DecisionInterval
+{
+    int64_t lo;
+    int64_t hi;
+};
+
+typedef std::vector<DecisionInterval> IntervalSet;
+
 struct DecisionExpr
 {
     DecisionOp op;
-    int value;
-    int value2;
+    int64_t value;
+    int64_t value2;
+
+    // only used by SET (compound expressions and set literals)
+    IntervalSet set;
 };
 
-bool decision_expr_eval(const DecisionExpr* expr, int var);
+bool decision_expr_eval(const DecisionExpr* expr, int64_t var);
+
+// convert between expressions and interval sets, compound expressions that
+// collapse to a single comparison get their simple op back
+IntervalSet decision_expr_intervals(const DecisionExpr& expr);
+DecisionExpr decision_expr_from_intervals(IntervalSet set);
+
+// format an expression in the syntax of the value attribute
+std::string decision_expr_format(const DecisionExpr& expr);
+
+// ------------------------------------------------------------------------
+// interval sets
+// ------------------------------------------------------------------------
+void interval_set_normalize(IntervalSet& set);
+
+IntervalSet interval_set_union(const IntervalSet& a, const IntervalSet& b);
+IntervalSet interval_set_intersect(const IntervalSet& a, const IntervalSet& b);
+IntervalSet interval_set_complement(const IntervalSet& set);
+
+bool interval_set_contains(const IntervalSet& set, int64_t var);
 
 // ------------------------------------------------------------------------
 // tree
@@ -51,8 +85,14 @@ struct TreeNode
     std::vector<TreeNode> choices;
 };
 
-const TreeNode* decision_tree_step(const TreeNode* node, int var);
-const TreeNode* decision_tree_step(const TreeNode* node, const std::string& var);
+const TreeNode* decision_tree_step(const TreeNode* node, int64_t var);
+const TreeNode* decision_tree_step(const TreeNode* node, std::string_view var);
+
+// step through the tree with one answer per node, stops at the first final node
+const TreeNode* decision_tree_walk(const TreeNode* node, const std::string_view* answers, size_t count);
+
+// rough footprint of a (sub)tree including the node itself and its heap allocations
+size_t tree_node_bytes(const TreeNode& node);
 
 // ------------------------------------------------------------------------
 // parsing
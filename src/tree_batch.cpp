@@ -0,0 +1,117 @@
+#include "tree_batch.h"
+
+#include <algorithm>
+
+struct TreeBatchTask
+{
+    const TreeNode* node;
+    size_t first;
+    size_t last;
+};
+
+// Moves the rows of [first, last) matching the predicate to the front and
+// returns their count. Both parts keep their order, rest is scratch space.
+template<typename Match>
+static size_t tree_batch_select(uint32_t* rows, size_t first, size_t last, uint32_t* rest, Match match)
+{
+    size_t selected = 0;
+    size_t skipped = 0;
+    for (size_t i = first; i < last; ++i)
+    {
+        uint32_t row = rows[i];
+        bool m = match(row);
+
+        // write both ways, advance only one (no branch on the data)
+        rows[first + selected] = row;
+        rest[skipped] = row;
+        selected += m;
+        skipped += !m;
+    }
+
+    std::copy(rest, rest + skipped, rows + first + selected);
+    return selected;
+}
+
+static size_t tree_batch_select_numbers(uint32_t* rows, size_t first, size_t last, uint32_t* rest, const int64_t* column, const DecisionExpr& expr)
+{
+    IntervalSet set = decision_expr_intervals(expr);
+    if (set.empty()) return 0;
+
+    if (set.size() == 1)
+    {
+        uint64_t lo = (uint64_t)set[0].lo;
+        uint64_t range = (uint64_t)set[0].hi - lo;
+        return tree_batch_select(rows, first, last, rest,
+            [=](uint32_t row) { return (uint64_t)column[row] - lo <= range; });
+    }
+
+    return tree_batch_select(rows, first, last, rest,
+        [&](uint32_t row) { return interval_set_contains(set, column[row]); });
+}
+
+static size_t tree_batch_select_options(uint32_t* rows, size_t first, size_t last, uint32_t* rest, const std::string_view* column, std::string_view value)
+{
+    return tree_batch_select(rows, first, last, rest,
+        [=](uint32_t row) { return column[row] == value; });
+}
+
+template<typename Column>
+static const Column* tree_batch_column(const std::unordered_map<std::string_view, const Column*>& columns, const std::string& name)
+{
+    auto found = columns.find(name);
+    return found != columns.end() ? found->second : nullptr;
+}
+
+void tree_batch_eval(const TreeNode& root, const TreeColumns& columns, const TreeNode** results)
+{
+    std::vector<uint32_t> rows(columns.rows);
+    std::vector<uint32_t> rest(columns.rows);
+    for (size_t i = 0; i < rows.size(); ++i)
+        rows[i] = (uint32_t)i;
+
+    std::vector<TreeBatchTask> stack = { { &root, 0, rows.size() } };
+    while (!stack.empty())
+    {
+        TreeBatchTask task = stack.back();
+        stack.pop_back();
+
+        const TreeNode* node = task.node;
+        size_t first = task.first;
+
+        const int64_t* numbers = nullptr;
+        const std::string_view* options = nullptr;
+        if (node->type == NodeType::DECISION)
+            numbers = tree_batch_column(columns.numbers, node->name);
+        else if (node->type == NodeType::OPTION)
+            options = tree_batch_column(columns.options, node->name);
+
+        if (numbers || options)
+        {
+            // like decision_tree_step the first matching choice wins, a choice
+            // with the wrong kind of value ends the search
+            for (const auto& choice : node->choices)
+            {
+                if (first == task.last) break;
+
+                size_t selected = 0;
+                if (auto expr = std::get_if<DecisionExpr>(&choice.value); expr && numbers)
+                    selected = tree_batch_select_numbers(rows.data(), first, task.last, rest.data(), numbers, *expr);
+                else if (auto str = std::get_if<std::string>(&choice.value); str && options)
+                    selected = tree_batch_select_options(rows.data(), first, task.last, rest.data(), options, *str);
+                else
+                    break;
+
+                if (selected && choice.type != NodeType::INVALID)
+                    stack.push_back({ &choice, first, first + selected });
+                else
+                    for (size_t i = first; i < first + selected; ++i) results[rows[i]] = nullptr;
+
+                first += selected;
+            }
+        }
+
+        const TreeNode* result = node->type == NodeType::FINAL ? node : nullptr;
+        for (size_t i = first; i < task.last; ++i)
+            results[rows[i]] = result;
+    }
+}
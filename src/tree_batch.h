@@ -0,0 +1,26 @@
+#pragma once
+
+#include "tree.h"
+
+#include <unordered_map>
+
+// ------------------------------------------------------------------------
+// columnar batch evaluation
+// ------------------------------------------------------------------------
+// Evaluates a parsed tree over a batch of rows stored by column, keyed by
+// node name: numbers for decision nodes, strings for option nodes. Instead
+// of walking row by row, every node filters the selection of rows that
+// reached it once per choice, splitting it into the rows taking the choice
+// and the rest. Each choice then continues on its own contiguous part of
+// the selection.
+//
+// Results are what stepping with decision_tree_step would end at: the
+// final node, or nullptr. Rows reaching a node without a column get nullptr.
+struct TreeColumns
+{
+    size_t rows;
+    std::unordered_map<std::string_view, const int64_t*> numbers;
+    std::unordered_map<std::string_view, const std::string_view*> options;
+};
+
+void tree_batch_eval(const TreeNode& root, const TreeColumns& columns, const TreeNode** results);
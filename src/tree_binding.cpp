@@ -0,0 +1,44 @@
+#include "tree_binding.h"
+
+#include <charconv>
+
+static bool tree_binding_lookup(std::string_view name, const TreeFieldValues& values, int64_t& number)
+{
+    for (const auto& value : values)
+    {
+        if (value.first != name) continue;
+        number = value.second;
+        return true;
+    }
+
+    // fields without a value table take the number the value spells
+    auto end = name.data() + name.size();
+    auto result = std::from_chars(name.data(), end, number);
+    return values.empty() && result.ec == std::errc() && result.ptr == end;
+}
+
+void tree_binding_resolve(CompiledTree& tree, const SymbolPool& symbols, uint32_t feature, const TreeFieldValues& values)
+{
+    for (uint32_t i = 0; i < tree.nodes.size(); ++i)
+    {
+        const PackedNode& parent = tree.nodes[i];
+        if (parent.type != (uint8_t)NodeType::OPTION || tree.vars[i] != feature) continue;
+
+        for (uint32_t c = parent.child; c < parent.child + parent.count; ++c)
+        {
+            PackedNode& choice = tree.nodes[c];
+            if ((PackedOp)choice.op != PackedOp::SYMBOL) continue;
+
+            std::string_view name = symbol_pool_get(symbols, (uint32_t)choice.lo);
+            int64_t value = 0;
+            if (!tree_binding_lookup(name, values, value) || value < 0 || value > UINT32_MAX)
+            {
+                printf("[warn] Option value %.*s has no bound value.\n", (int)name.size(), name.data());
+                choice.op = (uint8_t)PackedOp::NEVER;
+                continue;
+            }
+
+            choice.lo = (int32_t)(uint32_t)value;
+        }
+    }
+}
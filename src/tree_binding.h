@@ -0,0 +1,127 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+#include <cstdio>
+#include <type_traits>
+
+// ------------------------------------------------------------------------
+// typed binding
+// ------------------------------------------------------------------------
+// Binds the variables of a tree to the fields of a struct, so evaluation
+// reads int/enum fields directly instead of parsing answer strings:
+//
+//   TreeField<Trip> fields[] = {
+//       tree_field<&Trip::weather>("weather", { { "sunny", Weather::Sunny }, ... }),
+//       tree_field<&Trip::time>("time"),
+//   };
+//   tree_binding_build(binding, walker.root, fields, 2);
+//   std::string_view result = tree_binding_name(binding, tree_binding_eval(binding, trip));
+//
+// The field readers are generated at compile time from member pointers.
+// Option values are resolved once while binding: to the enum constant from
+// the field's value table, or to the number the value spells.
+template<typename M>
+struct TreeMemberTraits;
+
+template<typename C, typename F>
+struct TreeMemberTraits<F C::*>
+{
+    typedef C Class;
+    typedef F Field;
+};
+
+typedef std::vector<std::pair<std::string_view, int64_t>> TreeFieldValues;
+
+template<typename T>
+struct TreeField
+{
+    const char* name;
+    int64_t (*read)(const T& object);
+    TreeFieldValues values;     // option value names of an enum field
+};
+
+template<auto Member, typename Traits = TreeMemberTraits<decltype(Member)>>
+TreeField<typename Traits::Class> tree_field(const char* name,
+    std::initializer_list<std::pair<std::string_view, typename Traits::Field>> values = {})
+{
+    typedef typename Traits::Class Class;
+    static_assert(std::is_integral_v<typename Traits::Field> || std::is_enum_v<typename Traits::Field>,
+        "tree fields have to be integers or enums");
+
+    TreeField<Class> field = { name, [](const Class& object) { return (int64_t)(object.*Member); } };
+    for (const auto& value : values)
+        field.values.push_back({ value.first, (int64_t)value.second });
+    return field;
+}
+
+// rewrites the option choices of a feature to the bound values, values have
+// to fit in 32 bits unsigned, choices of unknown values become PackedOp::NEVER
+void tree_binding_resolve(CompiledTree& tree, const SymbolPool& symbols, uint32_t feature, const TreeFieldValues& values);
+
+template<typename T>
+struct TreeBinding
+{
+    SymbolPool symbols;
+    FeatureSet features;
+    CompiledTree tree;
+    std::vector<int64_t (*)(const T&)> readers;     // by feature, null if unbound
+};
+
+template<typename T>
+int tree_binding_build(TreeBinding<T>& binding, const TreeNode& root, const TreeField<T>* fields, size_t count)
+{
+    if (!compiled_tree_build(binding.tree, root, binding.symbols, binding.features))
+        return 0;
+
+    binding.readers.assign(binding.features.symbols.size(), nullptr);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t feature = feature_set_find(binding.features, symbol_pool_find(binding.symbols, fields[i].name));
+        if (feature == COMPILED_NONE)
+        {
+            printf("[warn] Field %s is not used by the tree.\n", fields[i].name);
+            continue;
+        }
+
+        if (binding.readers[feature])
+        {
+            printf("[warn] Field %s is bound twice.\n", fields[i].name);
+            return 0;
+        }
+
+        binding.readers[feature] = fields[i].read;
+        if (binding.features.types[feature] == NodeType::OPTION)
+            tree_binding_resolve(binding.tree, binding.symbols, feature, fields[i].values);
+    }
+
+    for (size_t i = 0; i < binding.readers.size(); ++i)
+    {
+        if (!binding.readers[i])
+            printf("[warn] Variable %s is not bound to a field.\n", symbol_pool_get(binding.symbols, binding.features.symbols[i]).data());
+    }
+    return 1;
+}
+
+// the final node reached or COMPILED_NONE, unbound variables end the walk
+template<typename T>
+uint32_t tree_binding_eval(const TreeBinding<T>& binding, const T& object)
+{
+    const CompiledTree& tree = binding.tree;
+
+    uint32_t node = 0;
+    while (node != COMPILED_NONE && tree.nodes[node].type != (uint8_t)NodeType::FINAL)
+    {
+        auto read = binding.readers[tree.vars[node]];
+        if (!read) return COMPILED_NONE;
+
+        node = compiled_tree_step(tree, node, read(object));
+    }
+    return node;
+}
+
+template<typename T>
+std::string_view tree_binding_name(const TreeBinding<T>& binding, uint32_t node)
+{
+    return node != COMPILED_NONE ? symbol_pool_get(binding.symbols, binding.tree.names[node]) : std::string_view();
+}
@@ -0,0 +1,546 @@
+#include "tree_delta.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define TREE_DELTA_VERSION 2
+
+// deeper than any tree read from XML, keeps reading a corrupt delta off the
+// end of the stack
+#define TREE_DELTA_MAX_DEPTH 1024
+
+// larger runs of changed choices are paired up by position
+#define TREE_DELTA_MAX_MATCH (1 << 20)
+
+// ------------------------------------------------------------------------
+// diff
+// ------------------------------------------------------------------------
+static bool tree_delta_same_value(const TreeNodeValue& a, const TreeNodeValue& b)
+{
+    if (a.index() != b.index()) return false;
+
+    if (auto str = std::get_if<std::string>(&a))
+        return *str == std::get<std::string>(b);
+
+    const DecisionExpr& x = std::get<DecisionExpr>(a);
+    const DecisionExpr& y = std::get<DecisionExpr>(b);
+    if (x.op != y.op || x.value != y.value || x.value2 != y.value2 || x.set.size() != y.set.size())
+        return false;
+
+    for (size_t i = 0; i < x.set.size(); ++i)
+        if (x.set[i].lo != y.set[i].lo || x.set[i].hi != y.set[i].hi) return false;
+
+    return true;
+}
+
+// Pairs of choices to diff against each other, in order. Choices with the
+// same value are paired first, the changed choices between two such pairs
+// are then paired by position, so a moved threshold doesn't turn into a
+// remove and an insert of everything below it.
+static std::vector<std::pair<size_t, size_t>> tree_delta_match(const std::vector<TreeNode>& a, const std::vector<TreeNode>& b)
+{
+    std::vector<std::pair<size_t, size_t>> same;
+    size_t n = a.size();
+    size_t m = b.size();
+
+    // choices mostly stay as they are, skip the common ends
+    size_t head = 0;
+    while (head < n && head < m && tree_delta_same_value(a[head].value, b[head].value))
+    {
+        same.push_back({ head, head });
+        head++;
+    }
+
+    size_t tail = 0;
+    while (tail < n - head && tail < m - head && tree_delta_same_value(a[n - 1 - tail].value, b[m - 1 - tail].value))
+        tail++;
+
+    // longest common subsequence of what is left, too large runs are left
+    // to the pairing by position
+    size_t rows = n - head - tail;
+    size_t cols = m - head - tail;
+    if (rows && cols && rows * cols <= TREE_DELTA_MAX_MATCH)
+    {
+        std::vector<uint32_t> lengths((rows + 1) * (cols + 1), 0);
+        auto at = [&](size_t i, size_t j) -> uint32_t& { return lengths[i * (cols + 1) + j]; };
+
+        for (size_t i = rows; i-- > 0;)
+            for (size_t j = cols; j-- > 0;)
+            {
+                if (tree_delta_same_value(a[head + i].value, b[head + j].value))
+                    at(i, j) = at(i + 1, j + 1) + 1;
+                else
+                    at(i, j) = std::max(at(i + 1, j), at(i, j + 1));
+            }
+
+        size_t i = 0, j = 0;
+        while (i < rows && j < cols)
+        {
+            if (tree_delta_same_value(a[head + i].value, b[head + j].value))
+                same.push_back({ head + i++, head + j++ });
+            else if (at(i + 1, j) >= at(i, j + 1))
+                i++;
+            else
+                j++;
+        }
+    }
+
+    for (size_t i = tail; i > 0; --i)
+        same.push_back({ n - i, m - i });
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+    size_t i = 0, j = 0;
+    same.push_back({ n, m });
+    for (auto [si, sj] : same)
+    {
+        for (; i < si && j < sj; ++i, ++j)
+            pairs.push_back({ i, j });
+
+        if (si == n) break;
+
+        pairs.push_back({ si, sj });
+        i = si + 1;
+        j = sj + 1;
+    }
+    return pairs;
+}
+
+static void tree_delta_diff_node(const TreeNode& from, const TreeNode& to, std::vector<uint32_t>& path, TreeDelta& delta)
+{
+    if (from.type != to.type || from.name != to.name || !tree_delta_same_value(from.value, to.value))
+        delta.entries.push_back({ TreeDeltaOp::MODIFY, path, 0, { to.type, to.name, to.value } });
+
+    auto pairs = tree_delta_match(from.choices, to.choices);
+    pairs.push_back({ from.choices.size(), to.choices.size() });
+
+    // index in the patched choices
+    uint32_t k = 0;
+    size_t i = 0, j = 0;
+    for (auto [pi, pj] : pairs)
+    {
+        for (; i < pi; ++i)
+        {
+            path.push_back(k);
+            delta.entries.push_back({ TreeDeltaOp::REMOVE, path, 0, {} });
+            path.pop_back();
+        }
+
+        for (; j < pj; ++j)
+            delta.entries.push_back({ TreeDeltaOp::INSERT, path, k++, to.choices[j] });
+
+        if (pi == from.choices.size()) break;
+
+        path.push_back(k++);
+        tree_delta_diff_node(from.choices[i++], to.choices[j++], path, delta);
+        path.pop_back();
+    }
+}
+
+TreeDelta tree_delta_diff(const TreeNode& from, const TreeNode& to)
+{
+    TreeDelta delta;
+    std::vector<uint32_t> path;
+    tree_delta_diff_node(from, to, path, delta);
+    return delta;
+}
+
+// the text of the name in another walker's table
+static const TreeTextRef* tree_delta_find_text(const TreeWalker& walker, const TreeTextTable& table, std::string_view name)
+{
+    return walker.symbols ? tree_text_find(table, symbol_pool_find(*walker.symbols, name)) : nullptr;
+}
+
+static void tree_delta_diff_texts(const TreeWalker& from, const TreeTextTable& a, const TreeWalker& to, const TreeTextTable& b, TreeDeltaText kind, TreeDelta& delta)
+{
+    for (const auto& entry : b)
+    {
+        std::string_view name = symbol_pool_get(*to.symbols, entry.symbol);
+        std::string_view text = tree_walker_text(to, entry.text);
+
+        const TreeTextRef* old = tree_delta_find_text(from, a, name);
+        if (!old || tree_walker_text(from, *old) != text)
+            delta.texts.push_back({ kind, false, std::string(name), std::string(text) });
+    }
+
+    for (const auto& entry : a)
+    {
+        std::string_view name = symbol_pool_get(*from.symbols, entry.symbol);
+        if (!tree_delta_find_text(to, b, name)) delta.texts.push_back({ kind, true, std::string(name), {} });
+    }
+}
+
+TreeDelta tree_delta_diff(const TreeWalker& from, const TreeWalker& to)
+{
+    TreeDelta delta = tree_delta_diff(from.root, to.root);
+    tree_delta_diff_texts(from, from.prompts, to, to.prompts, TreeDeltaText::PROMPT, delta);
+    tree_delta_diff_texts(from, from.results, to, to.results, TreeDeltaText::RESULT, delta);
+
+    std::string_view intro = tree_walker_text(to, to.intro);
+    if (tree_walker_text(from, from.intro) != intro)
+        delta.texts.push_back({ TreeDeltaText::INTRO, intro.empty(), {}, std::string(intro) });
+
+    return delta;
+}
+
+// ------------------------------------------------------------------------
+// apply
+// ------------------------------------------------------------------------
+// apply entry to root, which sits skip steps down the entry's path
+static int tree_delta_apply_entry(TreeNode& root, const TreeDeltaEntry& entry, size_t skip)
+{
+    size_t depth = entry.path.size();
+    if (entry.op == TreeDeltaOp::REMOVE)
+    {
+        if (depth == 0)
+        {
+            printf("[warn] The root can't be removed.\n");
+            return 0;
+        }
+        depth--;
+    }
+
+    TreeNode* node = &root;
+    for (size_t i = skip; i < depth; ++i)
+    {
+        if (entry.path[i] >= node->choices.size())
+        {
+            printf("[warn] Node %s has no choice %u.\n", node->name.c_str(), entry.path[i]);
+            return 0;
+        }
+        node = &node->choices[entry.path[i]];
+    }
+
+    switch (entry.op)
+    {
+    case TreeDeltaOp::MODIFY:
+        node->type = entry.node.type;
+        node->name = entry.node.name;
+        node->value = entry.node.value;
+        return 1;
+    case TreeDeltaOp::INSERT:
+        if (entry.index > node->choices.size()) break;
+        node->choices.insert(node->choices.begin() + entry.index, entry.node);
+        return 1;
+    case TreeDeltaOp::REMOVE:
+        if (entry.path.back() >= node->choices.size()) break;
+        node->choices.erase(node->choices.begin() + entry.path.back());
+        return 1;
+    }
+
+    printf("[warn] Node %s has no choice %u.\n", node->name.c_str(), entry.op == TreeDeltaOp::INSERT ? entry.index : entry.path.back());
+    return 0;
+}
+
+int tree_delta_apply(TreeNode& root, const TreeDelta& delta)
+{
+    for (const auto& entry : delta.entries)
+        if (!tree_delta_apply_entry(root, entry, 0)) return 0;
+
+    return 1;
+}
+
+int tree_delta_apply(TreeWalker& walker, const TreeDelta& delta)
+{
+    if (!tree_delta_apply(walker.root, delta)) return 0;
+
+    for (const auto& entry : delta.texts)
+    {
+        if (entry.kind == TreeDeltaText::INTRO)
+        {
+            walker.intro = entry.remove ? TreeTextRef{} : tree_walker_add_text(walker, entry.text);
+            continue;
+        }
+
+        if (!entry.remove)
+        {
+            if (entry.kind == TreeDeltaText::PROMPT)
+                tree_walker_set_prompt(walker, entry.name, entry.text);
+            else
+                tree_walker_set_result(walker, entry.name, entry.text);
+            continue;
+        }
+
+        auto& texts = entry.kind == TreeDeltaText::PROMPT ? walker.prompts : walker.results;
+        if (walker.symbols) tree_text_remove(texts, symbol_pool_find(*walker.symbols, entry.name));
+    }
+    return 1;
+}
+
+int tree_delta_apply(TreeEditor& editor, const TreeDelta& delta)
+{
+    if (delta.entries.empty()) return 1;
+
+    // path to the deepest node holding every entry, an insert or remove
+    // changes the node above, so no entry shifts a choice on this path
+    std::vector<uint32_t> prefix = delta.entries[0].path;
+    for (const auto& entry : delta.entries)
+    {
+        size_t depth = entry.path.size();
+        if (entry.op == TreeDeltaOp::REMOVE && depth > 0) depth--;
+
+        size_t common = 0;
+        while (common < std::min(depth, prefix.size()) && prefix[common] == entry.path[common])
+            common++;
+        prefix.resize(common);
+    }
+
+    auto version = tree_editor_acquire(editor);
+    const TreeEditNode* node = version->root.get();
+    for (uint32_t step : prefix)
+    {
+        if (step >= node->choices.size())
+        {
+            printf("[warn] Node %s has no choice %u.\n", node->name.c_str(), step);
+            return 0;
+        }
+        node = node->choices[step].get();
+    }
+
+    TreeNode subtree = tree_edit_materialize(*node);
+    for (const auto& entry : delta.entries)
+        if (!tree_delta_apply_entry(subtree, entry, prefix.size())) return 0;
+
+    return tree_editor_replace(editor, prefix.data(), prefix.size(), subtree);
+}
+
+// ------------------------------------------------------------------------
+// binary format
+// ------------------------------------------------------------------------
+static void tree_delta_write_u32(FILE* file, uint32_t value)
+{
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void tree_delta_write_string(FILE* file, const std::string& str)
+{
+    tree_delta_write_u32(file, (uint32_t)str.size());
+    fwrite(str.data(), 1, str.size(), file);
+}
+
+static void tree_delta_write_node(FILE* file, const TreeNode& node)
+{
+    fputc((int)node.type, file);
+    tree_delta_write_string(file, node.name);
+
+    if (auto str = std::get_if<std::string>(&node.value))
+    {
+        fputc(0, file);
+        tree_delta_write_string(file, *str);
+    }
+    else
+    {
+        const DecisionExpr& expr = std::get<DecisionExpr>(node.value);
+        fputc(1, file);
+        tree_delta_write_u32(file, (uint32_t)expr.op);
+        fwrite(&expr.value, sizeof(expr.value), 1, file);
+        fwrite(&expr.value2, sizeof(expr.value2), 1, file);
+        tree_delta_write_u32(file, (uint32_t)expr.set.size());
+        for (const auto& interval : expr.set)
+            fwrite(&interval, sizeof(interval), 1, file);
+    }
+
+    tree_delta_write_u32(file, (uint32_t)node.choices.size());
+    for (const auto& choice : node.choices)
+        tree_delta_write_node(file, choice);
+}
+
+int tree_delta_write(const TreeDelta& delta, FILE* file)
+{
+    fwrite("DTTD", 1, 4, file);
+    tree_delta_write_u32(file, TREE_DELTA_VERSION);
+    tree_delta_write_u32(file, (uint32_t)delta.entries.size());
+
+    for (const auto& entry : delta.entries)
+    {
+        fputc((int)entry.op, file);
+        tree_delta_write_u32(file, (uint32_t)entry.path.size());
+        for (uint32_t step : entry.path)
+            tree_delta_write_u32(file, step);
+
+        if (entry.op == TreeDeltaOp::INSERT)
+            tree_delta_write_u32(file, entry.index);
+
+        if (entry.op != TreeDeltaOp::REMOVE)
+            tree_delta_write_node(file, entry.node);
+    }
+
+    tree_delta_write_u32(file, (uint32_t)delta.texts.size());
+    for (const auto& entry : delta.texts)
+    {
+        fputc((int)entry.kind, file);
+        fputc(entry.remove ? 1 : 0, file);
+        tree_delta_write_string(file, entry.name);
+        if (!entry.remove)
+            tree_delta_write_string(file, entry.text);
+    }
+    return ferror(file) ? 0 : 1;
+}
+
+static bool tree_delta_read_bytes(FILE* file, void* data, size_t size)
+{
+    return fread(data, 1, size, file) == size;
+}
+
+static bool tree_delta_read_u32(FILE* file, uint32_t& value)
+{
+    return tree_delta_read_bytes(file, &value, sizeof(value));
+}
+
+// the size comes from the file, it has to fit in what is left of it
+static bool tree_delta_read_string(FILE* file, uint64_t left, std::string& str)
+{
+    uint32_t size;
+    if (!tree_delta_read_u32(file, size) || size > left) return false;
+
+    str.resize(size);
+    return tree_delta_read_bytes(file, str.data(), size);
+}
+
+static bool tree_delta_valid_op(uint32_t op)
+{
+    return op >= (uint32_t)DecisionOp::EQ && op <= (uint32_t)DecisionOp::SET;
+}
+
+static bool tree_delta_read_node(FILE* file, uint64_t left, TreeNode& node, uint32_t depth)
+{
+    if (depth > TREE_DELTA_MAX_DEPTH) return false;
+
+    int type = fgetc(file);
+    if (type < (int)NodeType::UNKNOWN || type > (int)NodeType::FINAL) return false;
+    node.type = (NodeType)type;
+
+    if (!tree_delta_read_string(file, left, node.name)) return false;
+
+    int kind = fgetc(file);
+    if (kind == 0)
+    {
+        std::string str;
+        if (!tree_delta_read_string(file, left, str)) return false;
+        node.value = std::move(str);
+    }
+    else if (kind == 1)
+    {
+        DecisionExpr expr = {};
+        uint32_t op, count;
+        if (!tree_delta_read_u32(file, op)
+            || !tree_delta_read_bytes(file, &expr.value, sizeof(expr.value))
+            || !tree_delta_read_bytes(file, &expr.value2, sizeof(expr.value2))
+            || !tree_delta_read_u32(file, count)
+            || !tree_delta_valid_op(op))
+            return false;
+
+        expr.op = (DecisionOp)op;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            // sets have to stay sorted and merged for the lookups
+            DecisionInterval interval;
+            if (!tree_delta_read_bytes(file, &interval, sizeof(interval)) || interval.lo > interval.hi
+                || (!expr.set.empty() && interval.lo <= expr.set.back().hi))
+                return false;
+            expr.set.push_back(interval);
+        }
+        node.value = std::move(expr);
+    }
+    else
+        return false;
+
+    uint32_t count;
+    if (!tree_delta_read_u32(file, count)) return false;
+
+    // grow as the choices arrive, the count isn't trusted
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        node.choices.emplace_back();
+        if (!tree_delta_read_node(file, left, node.choices.back(), depth + 1)) return false;
+    }
+    return true;
+}
+
+// bytes from the current position to the end of the file
+static uint64_t tree_delta_file_left(FILE* file)
+{
+    long start = ftell(file);
+    if (start < 0 || fseek(file, 0, SEEK_END) != 0) return 0;
+
+    long end = ftell(file);
+    fseek(file, start, SEEK_SET);
+    return end > start ? (uint64_t)(end - start) : 0;
+}
+
+int tree_delta_read(TreeDelta& delta, FILE* file)
+{
+    uint64_t left = tree_delta_file_left(file);
+
+    char magic[4];
+    uint32_t version, count;
+    if (!tree_delta_read_bytes(file, magic, 4) || memcmp(magic, "DTTD", 4) != 0
+        || !tree_delta_read_u32(file, version) || version < 1 || version > TREE_DELTA_VERSION
+        || !tree_delta_read_u32(file, count))
+    {
+        printf("[Error] Not a tree delta.\n");
+        return 0;
+    }
+
+    delta.entries.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        TreeDeltaEntry entry = {};
+        int op = fgetc(file);
+        uint32_t depth = 0;
+        bool ok = op >= (int)TreeDeltaOp::MODIFY && op <= (int)TreeDeltaOp::REMOVE
+            && tree_delta_read_u32(file, depth) && depth <= TREE_DELTA_MAX_DEPTH;
+
+        if (ok) entry.op = (TreeDeltaOp)op;
+
+        for (uint32_t d = 0; ok && d < depth; ++d)
+        {
+            uint32_t step;
+            ok = tree_delta_read_u32(file, step);
+            entry.path.push_back(step);
+        }
+
+        if (ok && entry.op == TreeDeltaOp::INSERT)
+            ok = tree_delta_read_u32(file, entry.index);
+
+        if (ok && entry.op != TreeDeltaOp::REMOVE)
+            ok = tree_delta_read_node(file, left, entry.node, entry.path.size());
+
+        if (!ok)
+        {
+            printf("[Error] Tree delta is truncated or corrupt (entry %u).\n", i);
+            return 0;
+        }
+        delta.entries.push_back(std::move(entry));
+    }
+
+    delta.texts.clear();
+    if (version < 2) return 1;
+
+    if (!tree_delta_read_u32(file, count))
+    {
+        printf("[Error] Tree delta is truncated or corrupt (texts).\n");
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        TreeDeltaTextEntry entry = {};
+        int kind = fgetc(file);
+        int remove = fgetc(file);
+        bool ok = kind >= (int)TreeDeltaText::PROMPT && kind <= (int)TreeDeltaText::INTRO
+            && (remove == 0 || remove == 1) && tree_delta_read_string(file, left, entry.name);
+
+        entry.kind = (TreeDeltaText)kind;
+        entry.remove = remove == 1;
+        if (ok && !entry.remove)
+            ok = tree_delta_read_string(file, left, entry.text);
+
+        if (!ok)
+        {
+            printf("[Error] Tree delta is truncated or corrupt (text %u).\n", i);
+            return 0;
+        }
+        delta.texts.push_back(std::move(entry));
+    }
+    return 1;
+}
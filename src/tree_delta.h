@@ -0,0 +1,92 @@
+#pragma once
+
+#include "tree.h"
+#include "tree_editor.h"
+#include "tree_walker.h"
+
+#include <cstdio>
+
+// ------------------------------------------------------------------------
+// tree deltas
+// ------------------------------------------------------------------------
+// Structural difference between two versions of a tree, as node edits that
+// are applied one after another. Paths are choice indices from the root
+// into the tree as the entries before left it.
+//
+//   MODIFY  set type, name and value of the node at path, keeping its choices
+//   INSERT  insert node, with everything below it, as choice index of the
+//           node at path
+//   REMOVE  remove the node at path
+//
+// The diff pairs up the choices of a node by their value (the expression or
+// option value leading into them), so the entries stay local to what
+// changed. The prompts, results and the intro are set or removed by name
+// after the nodes are patched, the intro has an empty name.
+//
+// Binary (host byte order): "DTTD", u32 version, u32 entries, then per entry
+// a u8 op, u32 depth and the path as u32s, for INSERT the u32 index, and for
+// MODIFY and INSERT the node: u8 type, u32 length + name, u8 value kind
+// (0 string, 1 expression) followed by u32 length + bytes or u32 op, int64
+// value, int64 value2, u32 count + int64 lo/hi pairs, then u32 choices and
+// the choices (none for MODIFY). Version 2 follows with u32 texts, per text
+// a u8 kind, u8 remove, u32 length + name and, unless removed, u32 length +
+// text. Version 1 files have no texts.
+enum class TreeDeltaOp : uint8_t
+{
+    MODIFY,
+    INSERT,
+    REMOVE
+};
+
+struct TreeDeltaEntry
+{
+    TreeDeltaOp op;
+    std::vector<uint32_t> path;
+    uint32_t index;     // INSERT only
+    TreeNode node;      // MODIFY and INSERT, choices only for INSERT
+};
+
+enum class TreeDeltaText : uint8_t
+{
+    PROMPT,
+    RESULT,
+    INTRO
+};
+
+struct TreeDeltaTextEntry
+{
+    TreeDeltaText kind;
+    bool remove;
+    std::string name;
+    std::string text;   // unless removed
+};
+
+struct TreeDelta
+{
+    std::vector<TreeDeltaEntry> entries;
+    std::vector<TreeDeltaTextEntry> texts;
+};
+
+// nodes only, the texts stay empty
+TreeDelta tree_delta_diff(const TreeNode& from, const TreeNode& to);
+
+// nodes and texts, walkers without text give no text entries
+TreeDelta tree_delta_diff(const TreeWalker& from, const TreeWalker& to);
+
+// patch the tree in place, on failure it is left with the entries before the
+// failing one applied
+int tree_delta_apply(TreeNode& root, const TreeDelta& delta);
+
+// patch the nodes and then the texts of a walker
+int tree_delta_apply(TreeWalker& walker, const TreeDelta& delta);
+
+// Patch the current version and publish the result as one new version. Only
+// the smallest subtree holding every entry gets recompiled. Assumes no other
+// edits happen at the same time. Editors hold no text, text entries are
+// ignored.
+int tree_delta_apply(TreeEditor& editor, const TreeDelta& delta);
+
+int tree_delta_write(const TreeDelta& delta, FILE* file);
+
+// lengths in the file are checked against the bytes left in it
+int tree_delta_read(TreeDelta& delta, FILE* file);
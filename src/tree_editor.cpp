@@ -0,0 +1,455 @@
+#include "tree_editor.h"
+
+#include "compiled_layout.h"
+
+#include <algorithm>
+#include <functional>
+
+TreeEditRef tree_edit_node(const TreeNode& node)
+{
+    auto edit = std::make_shared<TreeEditNode>();
+    edit->type = node.type;
+    edit->name = node.name;
+    edit->value = node.value;
+
+    edit->choices.reserve(node.choices.size());
+    for (const auto& choice : node.choices)
+        edit->choices.push_back(tree_edit_node(choice));
+
+    return edit;
+}
+
+TreeNode tree_edit_materialize(const TreeEditNode& node)
+{
+    TreeNode result = { node.type, node.name, node.value };
+
+    result.choices.reserve(node.choices.size());
+    for (const auto& choice : node.choices)
+        result.choices.push_back(tree_edit_materialize(*choice));
+
+    return result;
+}
+
+// ------------------------------------------------------------------------
+// chunks
+// ------------------------------------------------------------------------
+const PackedNode& tree_edit_packed(const TreeEditTree& tree, uint32_t node)
+{
+    return tree.chunks[node >> TREE_EDIT_CHUNK_BITS]->nodes[node & (TREE_EDIT_CHUNK - 1)];
+}
+
+uint32_t tree_edit_name(const TreeEditTree& tree, uint32_t node)
+{
+    return tree.chunks[node >> TREE_EDIT_CHUNK_BITS]->names[node & (TREE_EDIT_CHUNK - 1)];
+}
+
+uint32_t tree_edit_eval(const TreeEditTree& tree, const int64_t* record)
+{
+    const DecisionInterval* intervals = tree.intervals->data();
+
+    uint32_t node = 0;
+    while (true)
+    {
+        const TreeEditChunk& chunk = *tree.chunks[node >> TREE_EDIT_CHUNK_BITS];
+        const PackedNode& parent = chunk.nodes[node & (TREE_EDIT_CHUNK - 1)];
+        if (parent.type == (uint8_t)NodeType::FINAL) return node;
+
+        int64_t var = record[chunk.vars[node & (TREE_EDIT_CHUNK - 1)]];
+
+        uint32_t next = COMPILED_NONE;
+        for (uint32_t i = parent.child; i < parent.child + parent.count; ++i)
+        {
+            const PackedNode& choice = tree_edit_packed(tree, i);
+            if (compiled_tree_match(choice, intervals, var))
+            {
+                next = choice.type == (uint8_t)NodeType::INVALID ? COMPILED_NONE : i;
+                break;
+            }
+        }
+
+        if (next == COMPILED_NONE) return COMPILED_NONE;
+        node = next;
+    }
+}
+
+void tree_edit_flatten(const TreeEditTree& tree, CompiledTree& flat)
+{
+    flat.nodes.resize(tree.size);
+    flat.vars.resize(tree.size);
+    flat.names.resize(tree.size);
+
+    for (uint32_t first = 0; first < tree.size; first += TREE_EDIT_CHUNK)
+    {
+        const TreeEditChunk& chunk = *tree.chunks[first >> TREE_EDIT_CHUNK_BITS];
+        uint32_t count = std::min(TREE_EDIT_CHUNK, tree.size - first);
+        std::copy(chunk.nodes, chunk.nodes + count, flat.nodes.begin() + first);
+        std::copy(chunk.vars, chunk.vars + count, flat.vars.begin() + first);
+        std::copy(chunk.names, chunk.names + count, flat.names.begin() + first);
+    }
+
+    flat.intervals = *tree.intervals;
+}
+
+uint32_t tree_edit_symbol(TreeEditSymbols& symbols, std::string_view str)
+{
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+    return symbol_pool_find(symbols.pool, str);
+}
+
+std::string_view tree_edit_symbol_name(TreeEditSymbols& symbols, uint32_t symbol)
+{
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+    return symbol_pool_get(symbols.pool, symbol);
+}
+
+// the chunk holding index, copied first unless this version wrote it
+static TreeEditChunk& tree_editor_chunk(TreeEditTree& tree, uint64_t version, uint32_t index)
+{
+    auto& chunk = tree.chunks[index >> TREE_EDIT_CHUNK_BITS];
+    if (chunk->version != version)
+    {
+        chunk = std::make_shared<TreeEditChunk>(*chunk);
+        chunk->version = version;
+    }
+    return *chunk;
+}
+
+static void tree_editor_set(TreeEditTree& tree, uint64_t version, uint32_t index, const PackedNode& node, uint32_t name, uint32_t var)
+{
+    TreeEditChunk& chunk = tree_editor_chunk(tree, version, index);
+    chunk.nodes[index & (TREE_EDIT_CHUNK - 1)] = node;
+    chunk.names[index & (TREE_EDIT_CHUNK - 1)] = name;
+    chunk.vars[index & (TREE_EDIT_CHUNK - 1)] = var;
+}
+
+static uint32_t tree_editor_push(TreeEditTree& tree, uint64_t version, const PackedNode& node, uint32_t name, uint32_t var)
+{
+    if (tree.size == tree.chunks.size() * TREE_EDIT_CHUNK)
+    {
+        tree.chunks.push_back(std::make_shared<TreeEditChunk>());
+        tree.chunks.back()->version = version;
+    }
+
+    tree_editor_set(tree, version, tree.size, node, name, var);
+    return tree.size++;
+}
+
+static void tree_editor_chunk_tree(TreeEditTree& tree, const CompiledTree& flat, uint64_t version)
+{
+    tree.chunks.clear();
+    tree.size = 0;
+    for (uint32_t i = 0; i < flat.nodes.size(); ++i)
+        tree_editor_push(tree, version, flat.nodes[i], flat.names[i], flat.vars[i]);
+
+    tree.intervals = std::make_shared<IntervalSet>(flat.intervals);
+}
+
+// ------------------------------------------------------------------------
+// versions
+// ------------------------------------------------------------------------
+static std::shared_ptr<TreeEditVersion> tree_editor_build(const TreeNode& root, uint64_t number, std::shared_ptr<TreeEditSymbols> symbols)
+{
+    auto version = std::make_shared<TreeEditVersion>();
+    version->number = number;
+    version->root = tree_edit_node(root);
+    version->symbols = std::move(symbols);
+    version->features = std::make_shared<FeatureSet>();
+    version->garbage = 0;
+
+    CompiledTree flat;
+    {
+        std::lock_guard<std::mutex> lock(version->symbols->mutex);
+        if (!compiled_tree_build(flat, root, version->symbols->pool, *version->features))
+            return nullptr;
+    }
+
+    tree_editor_chunk_tree(version->tree, flat, number);
+    return version;
+}
+
+// true if compiling subtree could add features
+static bool tree_editor_adds_features(TreeEditSymbols& symbols, const TreeNode& subtree, const FeatureSet& features)
+{
+    std::lock_guard<std::mutex> lock(symbols.mutex);
+
+    std::vector<const TreeNode*> stack = { &subtree };
+    while (!stack.empty())
+    {
+        const TreeNode* node = stack.back();
+        stack.pop_back();
+
+        bool variable = node->type == NodeType::DECISION || node->type == NodeType::OPTION;
+        if (variable && feature_set_find(features, symbol_pool_find(symbols.pool, node->name)) == COMPILED_NONE)
+            return true;
+
+        for (const auto& choice : node->choices)
+            stack.push_back(&choice);
+    }
+    return false;
+}
+
+// the next version shares the chunks, features are copied only if the
+// subtree adds to them, published ones are never changed
+static std::shared_ptr<TreeEditVersion> tree_editor_next(const TreeEditVersion& base, const TreeNode* subtree)
+{
+    auto version = std::make_shared<TreeEditVersion>();
+    version->number = base.number + 1;
+    version->root = base.root;
+    version->symbols = base.symbols;
+    version->features = base.features;
+    version->tree = base.tree;
+    version->garbage = base.garbage;
+
+    if (subtree && tree_editor_adds_features(*base.symbols, *subtree, *base.features))
+        version->features = std::make_shared<FeatureSet>(*base.features);
+
+    return version;
+}
+
+// compile subtree as a choice of a parent_type node into the entry at index,
+// appending everything below it
+static int tree_editor_graft(TreeEditVersion& version, uint32_t index, const TreeNode& subtree, NodeType parent_type)
+{
+    // compiled on its own first, its root stands in for the entry at index
+    CompiledTree scratch;
+    scratch.nodes.resize(1);
+    scratch.names.resize(1);
+    scratch.vars.resize(1);
+    {
+        std::lock_guard<std::mutex> lock(version.symbols->mutex);
+        if (!compiled_tree_graft(scratch, 0, subtree, parent_type, version.symbols->pool, *version.features))
+            return 0;
+    }
+
+    uint32_t first = version.tree.size - 1;
+    int32_t offset = (int32_t)version.tree.intervals->size();
+    if (!scratch.intervals.empty())
+    {
+        auto intervals = std::make_shared<IntervalSet>(*version.tree.intervals);
+        intervals->insert(intervals->end(), scratch.intervals.begin(), scratch.intervals.end());
+        version.tree.intervals = intervals;
+    }
+
+    for (uint32_t i = 0; i < scratch.nodes.size(); ++i)
+    {
+        PackedNode node = scratch.nodes[i];
+        if (node.count > 0) node.child += first;
+        if (node.op == (uint8_t)PackedOp::SET) node.lo += offset;
+
+        if (i == 0)
+            tree_editor_set(version.tree, version.number, index, node, scratch.names[i], scratch.vars[i]);
+        else
+            tree_editor_push(version.tree, version.number, node, scratch.names[i], scratch.vars[i]);
+    }
+    return 1;
+}
+
+static void tree_editor_publish(TreeEditor& editor, std::shared_ptr<TreeEditVersion> version)
+{
+    size_t live = version->tree.size - version->garbage;
+    if (version->garbage > live)
+    {
+        CompiledTree flat;
+        tree_edit_flatten(version->tree, flat);
+        compiled_tree_relayout(flat, TreeLayout::BFS);
+        tree_editor_chunk_tree(version->tree, flat, version->number);
+        version->garbage = 0;
+    }
+
+    std::atomic_store(&editor.current, std::shared_ptr<const TreeEditVersion>(std::move(version)));
+}
+
+// ------------------------------------------------------------------------
+// paths
+// ------------------------------------------------------------------------
+// compiled index of the node at path, COMPILED_NONE if the path leaves the tree
+static uint32_t tree_editor_resolve(const TreeEditVersion& version, const uint32_t* path, size_t depth, const TreeEditNode** node)
+{
+    const TreeEditNode* src = version.root.get();
+    uint32_t index = 0;
+    for (size_t i = 0; i < depth; ++i)
+    {
+        if (path[i] >= src->choices.size())
+        {
+            printf("[warn] Node %s has no choice %u.\n", src->name.c_str(), path[i]);
+            return COMPILED_NONE;
+        }
+
+        index = tree_edit_packed(version.tree, index).child + path[i];
+        src = src->choices[path[i]].get();
+    }
+
+    if (node) *node = src;
+    return index;
+}
+
+// copy the source nodes down to the node at path and apply edit to its copy
+static TreeEditRef tree_editor_copy_path(const TreeEditRef& node, const uint32_t* path, size_t depth, const std::function<void(TreeEditNode&)>& edit)
+{
+    auto copy = std::make_shared<TreeEditNode>(*node);
+    if (depth == 0)
+        edit(*copy);
+    else
+        copy->choices[path[0]] = tree_editor_copy_path(node->choices[path[0]], path + 1, depth - 1, edit);
+
+    return copy;
+}
+
+// number of compiled nodes in the subtree at index
+static size_t tree_editor_count(const TreeEditTree& tree, uint32_t index)
+{
+    size_t count = 0;
+    std::vector<uint32_t> stack = { index };
+    while (!stack.empty())
+    {
+        const PackedNode& node = tree_edit_packed(tree, stack.back());
+        stack.pop_back();
+        count++;
+
+        for (uint32_t c = node.child; c < node.child + node.count; ++c)
+            stack.push_back(c);
+    }
+    return count;
+}
+
+// move the choices of the node at index to a new block at the end, leaving
+// out choice skip and leaving an empty slot at insert (COMPILED_NONE for neither)
+static void tree_editor_reblock(TreeEditTree& tree, uint64_t version, uint32_t index, uint32_t skip, uint32_t insert)
+{
+    PackedNode parent = tree_edit_packed(tree, index);
+    uint32_t block = tree.size;
+
+    for (uint32_t i = 0; i <= parent.count; ++i)
+    {
+        if (i == insert)
+            tree_editor_push(tree, version, {}, SYMBOL_NONE, COMPILED_NONE);
+
+        if (i == parent.count || i == skip) continue;
+
+        // copy before pushing, the push may copy the chunk
+        uint32_t at = parent.child + i;
+        const TreeEditChunk& chunk = *tree.chunks[at >> TREE_EDIT_CHUNK_BITS];
+        PackedNode node = chunk.nodes[at & (TREE_EDIT_CHUNK - 1)];
+        uint32_t name = chunk.names[at & (TREE_EDIT_CHUNK - 1)];
+        uint32_t var = chunk.vars[at & (TREE_EDIT_CHUNK - 1)];
+        tree_editor_push(tree, version, node, name, var);
+    }
+
+    parent.child = block;
+    parent.count = (uint16_t)(tree.size - block);
+    const TreeEditChunk& chunk = *tree.chunks[index >> TREE_EDIT_CHUNK_BITS];
+    tree_editor_set(tree, version, index, parent, chunk.names[index & (TREE_EDIT_CHUNK - 1)], chunk.vars[index & (TREE_EDIT_CHUNK - 1)]);
+}
+
+// ------------------------------------------------------------------------
+// editing
+// ------------------------------------------------------------------------
+int tree_editor_open(TreeEditor& editor, const TreeNode& root)
+{
+    auto version = tree_editor_build(root, 1, std::make_shared<TreeEditSymbols>());
+    if (!version) return 0;
+
+    std::lock_guard<std::mutex> lock(editor.edit_mutex);
+    tree_editor_publish(editor, version);
+    return 1;
+}
+
+std::shared_ptr<const TreeEditVersion> tree_editor_acquire(const TreeEditor& editor)
+{
+    return std::atomic_load(&editor.current);
+}
+
+int tree_editor_replace(TreeEditor& editor, const uint32_t* path, size_t depth, const TreeNode& subtree)
+{
+    std::lock_guard<std::mutex> lock(editor.edit_mutex);
+    auto base = editor.current;
+
+    if (depth == 0)
+    {
+        auto version = tree_editor_build(subtree, base->number + 1, base->symbols);
+        if (!version) return 0;
+
+        tree_editor_publish(editor, version);
+        return 1;
+    }
+
+    const TreeEditNode* parent = nullptr;
+    if (tree_editor_resolve(*base, path, depth - 1, &parent) == COMPILED_NONE) return 0;
+
+    uint32_t index = tree_editor_resolve(*base, path, depth, nullptr);
+    if (index == COMPILED_NONE) return 0;
+
+    auto version = tree_editor_next(*base, &subtree);
+
+    // the entry is reused, everything below it is left behind
+    version->garbage += tree_editor_count(version->tree, index) - 1;
+    if (!tree_editor_graft(*version, index, subtree, parent->type))
+        return 0;
+
+    TreeEditRef node = tree_edit_node(subtree);
+    version->root = tree_editor_copy_path(base->root, path, depth - 1,
+        [&](TreeEditNode& copy) { copy.choices[path[depth - 1]] = node; });
+
+    tree_editor_publish(editor, version);
+    return 1;
+}
+
+int tree_editor_insert(TreeEditor& editor, const uint32_t* path, size_t depth, uint32_t index, const TreeNode& subtree)
+{
+    std::lock_guard<std::mutex> lock(editor.edit_mutex);
+    auto base = editor.current;
+
+    const TreeEditNode* parent = nullptr;
+    uint32_t parent_index = tree_editor_resolve(*base, path, depth, &parent);
+    if (parent_index == COMPILED_NONE) return 0;
+
+    if (index > parent->choices.size() || parent->choices.size() >= UINT16_MAX)
+    {
+        printf("[warn] Can't insert choice %u into node %s.\n", index, parent->name.c_str());
+        return 0;
+    }
+
+    auto version = tree_editor_next(*base, &subtree);
+
+    version->garbage += tree_edit_packed(base->tree, parent_index).count;
+    tree_editor_reblock(version->tree, version->number, parent_index, COMPILED_NONE, index);
+
+    uint32_t slot = tree_edit_packed(version->tree, parent_index).child + index;
+    if (!tree_editor_graft(*version, slot, subtree, parent->type))
+        return 0;
+
+    TreeEditRef node = tree_edit_node(subtree);
+    version->root = tree_editor_copy_path(base->root, path, depth,
+        [&](TreeEditNode& copy) { copy.choices.insert(copy.choices.begin() + index, node); });
+
+    tree_editor_publish(editor, version);
+    return 1;
+}
+
+int tree_editor_remove(TreeEditor& editor, const uint32_t* path, size_t depth)
+{
+    if (depth == 0)
+    {
+        printf("[warn] The root can't be removed.\n");
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(editor.edit_mutex);
+    auto base = editor.current;
+
+    uint32_t parent_index = tree_editor_resolve(*base, path, depth - 1, nullptr);
+    uint32_t index = tree_editor_resolve(*base, path, depth, nullptr);
+    if (parent_index == COMPILED_NONE || index == COMPILED_NONE) return 0;
+
+    auto version = tree_editor_next(*base, nullptr);
+
+    // the old block and everything below the removed choice
+    version->garbage += tree_edit_packed(version->tree, parent_index).count + tree_editor_count(version->tree, index) - 1;
+    tree_editor_reblock(version->tree, version->number, parent_index, path[depth - 1], COMPILED_NONE);
+
+    version->root = tree_editor_copy_path(base->root, path, depth - 1,
+        [&](TreeEditNode& copy) { copy.choices.erase(copy.choices.begin() + path[depth - 1]); });
+
+    tree_editor_publish(editor, version);
+    return 1;
+}
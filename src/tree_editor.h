@@ -0,0 +1,111 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+#include <memory>
+#include <mutex>
+
+// ------------------------------------------------------------------------
+// tree editing
+// ------------------------------------------------------------------------
+// Edits a loaded tree one subtree at a time without rebuilding it. The
+// source nodes are immutable and shared between versions, an edit copies
+// only the nodes on the path to the change. Node paths are choice indices
+// from the root, which also address the compiled tree, since the choices
+// of every compiled node stay in order.
+//
+// The compiled nodes are kept in chunks shared between versions, a version
+// starts with the chunk list of the previous one and copies a chunk only
+// when the edit writes into it. The new subtree gets compiled into space
+// appended at the end, and a node with an inserted or removed choice gets a
+// new block of choices. What is left unreachable is dropped by a relayout
+// once it outweighs the live nodes. Features and the interval table are
+// shared until an edit brings new ones. Symbols are shared by all versions
+// of an editor and only grow, so they're looked up under their mutex.
+//
+// Every edit publishes a new version, readers keep the version they
+// acquired for as long as they hold it.
+struct TreeEditNode
+{
+    NodeType type;
+    std::string name;
+    TreeNodeValue value;
+    std::vector<std::shared_ptr<const TreeEditNode>> choices;
+};
+
+typedef std::shared_ptr<const TreeEditNode> TreeEditRef;
+
+#define TREE_EDIT_CHUNK_BITS 10
+#define TREE_EDIT_CHUNK (1u << TREE_EDIT_CHUNK_BITS)
+
+struct TreeEditChunk
+{
+    uint64_t version;   // written by this version, frozen once it's published
+    PackedNode nodes[TREE_EDIT_CHUNK];
+    uint32_t vars[TREE_EDIT_CHUNK];
+    uint32_t names[TREE_EDIT_CHUNK];
+};
+
+// the nodes of a CompiledTree, node i is in chunk i / TREE_EDIT_CHUNK
+struct TreeEditTree
+{
+    std::vector<std::shared_ptr<TreeEditChunk>> chunks;
+    uint32_t size;
+    std::shared_ptr<const IntervalSet> intervals;
+};
+
+struct TreeEditSymbols
+{
+    SymbolPool pool;
+    std::mutex mutex;
+};
+
+struct TreeEditVersion
+{
+    uint64_t number;
+    TreeEditRef root;
+
+    // never changed once published, symbols only grow
+    std::shared_ptr<TreeEditSymbols> symbols;
+    std::shared_ptr<FeatureSet> features;
+    TreeEditTree tree;
+
+    size_t garbage;     // compiled nodes no longer reachable
+};
+
+struct TreeEditor
+{
+    std::shared_ptr<const TreeEditVersion> current;
+    std::mutex edit_mutex;
+};
+
+int tree_editor_open(TreeEditor& editor, const TreeNode& root);
+
+std::shared_ptr<const TreeEditVersion> tree_editor_acquire(const TreeEditor& editor);
+
+// replace the node at path (the root for depth 0) with subtree
+int tree_editor_replace(TreeEditor& editor, const uint32_t* path, size_t depth, const TreeNode& subtree);
+
+// insert subtree as choice index of the node at path
+int tree_editor_insert(TreeEditor& editor, const uint32_t* path, size_t depth, uint32_t index, const TreeNode& subtree);
+
+// remove the node at path, depth has to be at least 1
+int tree_editor_remove(TreeEditor& editor, const uint32_t* path, size_t depth);
+
+TreeEditRef tree_edit_node(const TreeNode& node);
+TreeNode tree_edit_materialize(const TreeEditNode& node);
+
+// walk from the root, returns the reached final node or COMPILED_NONE
+uint32_t tree_edit_eval(const TreeEditTree& tree, const int64_t* record);
+
+const PackedNode& tree_edit_packed(const TreeEditTree& tree, uint32_t node);
+
+// symbol id of the name of a node
+uint32_t tree_edit_name(const TreeEditTree& tree, uint32_t node);
+
+// copy into one flat CompiledTree
+void tree_edit_flatten(const TreeEditTree& tree, CompiledTree& flat);
+
+// lookups in the pool of an editor, safe while edits add to it
+uint32_t tree_edit_symbol(TreeEditSymbols& symbols, std::string_view str);
+std::string_view tree_edit_symbol_name(TreeEditSymbols& symbols, uint32_t symbol);
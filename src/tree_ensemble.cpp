@@ -0,0 +1,167 @@
+#include "tree_ensemble.h"
+
+#include "tree_walker.h"
+
+#include <charconv>
+#include <cmath>
+#include <thread>
+
+#define ENSEMBLE_BLOCK 256
+#define ENSEMBLE_GROUP 16
+
+// assign a class id to every result name of the tree
+static void tree_ensemble_add_classes(TreeEnsemble& ensemble, const CompiledTree& tree)
+{
+    for (size_t i = 0; i < tree.nodes.size(); ++i)
+    {
+        if (tree.nodes[i].type != (uint8_t)NodeType::FINAL) continue;
+
+        uint32_t symbol = tree.names[i];
+        if (symbol >= ensemble.classes.size())
+        {
+            ensemble.classes.resize(symbol + 1, SYMBOL_NONE);
+            ensemble.values.resize(symbol + 1, NAN);
+        }
+
+        if (ensemble.classes[symbol] != SYMBOL_NONE) continue;
+        ensemble.classes[symbol] = ensemble.class_count++;
+
+        std::string_view name = symbol_pool_get(ensemble.symbols, symbol);
+        double value = 0.0;
+        auto result = std::from_chars(name.data(), name.data() + name.size(), value);
+        if (result.ec == std::errc() && result.ptr == name.data() + name.size())
+            ensemble.values[symbol] = value;
+    }
+}
+
+int tree_ensemble_add(TreeEnsemble& ensemble, const TreeNode& root, double weight)
+{
+    CompiledTree tree;
+    if (!compiled_tree_build(tree, root, ensemble.symbols, ensemble.features))
+        return 0;
+
+    tree_ensemble_add_classes(ensemble, tree);
+
+    ensemble.trees.push_back(std::move(tree));
+    ensemble.weights.push_back(weight);
+    return 1;
+}
+
+int tree_ensemble_load(TreeEnsemble& ensemble, const char* const* filenames, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        TreeWalker walker;
+        if (!tree_walker_load(walker, filenames[i], TreeWalkerText::NONE))
+            return 0;
+
+        if (!tree_ensemble_add(ensemble, walker.root, 1.0))
+            return 0;
+    }
+    return 1;
+}
+
+int tree_ensemble_decode(const TreeEnsemble& ensemble, const std::string_view* names, const std::string_view* answers, size_t count, int64_t* record)
+{
+    const FeatureSet& features = ensemble.features;
+    for (size_t i = 0; i < features.symbols.size(); ++i)
+        record[i] = features.types[i] == NodeType::OPTION ? SYMBOL_NONE : INT64_MIN;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t feature = feature_set_find(features, symbol_pool_find(ensemble.symbols, names[i]));
+        if (feature == COMPILED_NONE) continue;
+
+        if (features.types[feature] == NodeType::OPTION)
+        {
+            record[feature] = symbol_pool_find(ensemble.symbols, answers[i]);
+            continue;
+        }
+
+        auto end = answers[i].data() + answers[i].size();
+        auto result = std::from_chars(answers[i].data(), end, record[feature]);
+        if (result.ec != std::errc() || result.ptr != end)
+        {
+            printf("[warn] Answer %.*s for %.*s has to be a number.\n",
+                (int)answers[i].size(), answers[i].data(), (int)names[i].size(), names[i].data());
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Records are processed in blocks, the trees are walked one after another
+// over a whole block, so the upper levels of each tree stay in cache.
+static void tree_ensemble_vote_range(const TreeEnsemble* ensemble, const int64_t* records, size_t first, size_t last, EnsembleVote* votes)
+{
+    size_t width = ensemble->features.symbols.size();
+    size_t classes = ensemble->class_count;
+
+    std::vector<uint32_t> results(ENSEMBLE_BLOCK);
+    std::vector<double> counts(ENSEMBLE_BLOCK * classes);
+    std::vector<double> scores(ENSEMBLE_BLOCK);
+
+    for (size_t block = first; block < last; block += ENSEMBLE_BLOCK)
+    {
+        size_t count = std::min<size_t>(ENSEMBLE_BLOCK, last - block);
+        std::fill(counts.begin(), counts.end(), 0.0);
+        std::fill(scores.begin(), scores.end(), 0.0);
+
+        for (size_t t = 0; t < ensemble->trees.size(); ++t)
+        {
+            const CompiledTree& tree = ensemble->trees[t];
+            double weight = ensemble->weights[t];
+
+            compiled_tree_eval_batch(tree, records + block * width, width, count, results.data(), ENSEMBLE_GROUP);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (results[i] == COMPILED_NONE) continue;
+
+                uint32_t symbol = tree.names[results[i]];
+                counts[i * classes + ensemble->classes[symbol]] += weight;
+
+                double value = ensemble->values[symbol];
+                if (!std::isnan(value)) scores[i] += weight * value;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // ties go to the class seen first while loading
+            const double* votes_of = counts.data() + i * classes;
+            uint32_t best = SYMBOL_NONE;
+            for (uint32_t c = 0; c < classes; ++c)
+            {
+                if (votes_of[c] > 0.0 && (best == SYMBOL_NONE || votes_of[c] > votes_of[best]))
+                    best = c;
+            }
+            votes[block + i] = { best, scores[i] };
+        }
+    }
+
+    // translate class ids back to symbols
+    std::vector<uint32_t> symbols(classes);
+    for (uint32_t s = 0; s < ensemble->classes.size(); ++s)
+        if (ensemble->classes[s] != SYMBOL_NONE) symbols[ensemble->classes[s]] = s;
+
+    for (size_t i = first; i < last; ++i)
+        if (votes[i].result != SYMBOL_NONE) votes[i].result = symbols[votes[i].result];
+}
+
+void tree_ensemble_vote(const TreeEnsemble& ensemble, const int64_t* records, size_t count, EnsembleVote* votes, size_t threads)
+{
+    if (threads <= 1 || count < threads * ENSEMBLE_BLOCK)
+    {
+        tree_ensemble_vote_range(&ensemble, records, 0, count, votes);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunk = (count + threads - 1) / threads;
+    for (size_t first = 0; first < count; first += chunk)
+        workers.emplace_back(tree_ensemble_vote_range, &ensemble, records, first, std::min(count, first + chunk), votes);
+
+    for (auto& worker : workers)
+        worker.join();
+}
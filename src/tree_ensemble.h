@@ -0,0 +1,40 @@
+#pragma once
+
+#include "compiled_tree.h"
+
+// ------------------------------------------------------------------------
+// tree ensemble
+// ------------------------------------------------------------------------
+// Many trees evaluated over the same records. All trees share one symbol
+// pool and one feature set, so a record is decoded once into a flat feature
+// vector that every tree reads from.
+struct TreeEnsemble
+{
+    SymbolPool symbols;
+    FeatureSet features;
+
+    std::vector<CompiledTree> trees;
+    std::vector<double> weights;
+
+    // dense class id and numeric value (NaN if not a number) of result names by symbol
+    std::vector<uint32_t> classes;
+    std::vector<double> values;
+    uint32_t class_count = 0;
+};
+
+struct EnsembleVote
+{
+    uint32_t result;    // symbol id of the winning result name or SYMBOL_NONE
+    double score;       // weighted sum of the numeric results
+};
+
+int tree_ensemble_add(TreeEnsemble& ensemble, const TreeNode& root, double weight);
+int tree_ensemble_load(TreeEnsemble& ensemble, const char* const* filenames, size_t count);
+
+// decode named answers into a record of ensemble.features.symbols.size() values,
+// missing answers never match an option and compare as INT64_MIN in decisions
+int tree_ensemble_decode(const TreeEnsemble& ensemble, const std::string_view* names, const std::string_view* answers, size_t count, int64_t* record);
+
+// evaluate all trees for count records and aggregate by weighted majority vote,
+// the records are split over the given number of threads
+void tree_ensemble_vote(const TreeEnsemble& ensemble, const int64_t* records, size_t count, EnsembleVote* votes, size_t threads);
@@ -0,0 +1,130 @@
+#include "tree_evaluator.h"
+
+#include <charconv>
+
+static const std::string* tree_evaluation_answer(const TreeEvaluation* evaluation, const std::string& name)
+{
+    for (const auto& answer : evaluation->answers)
+        if (*answer.first == name) return &answer.second;
+    return nullptr;
+}
+
+static const TreeNode* tree_evaluation_step(const TreeNode* node, const std::string& answer)
+{
+    if (node->type == NodeType::OPTION)
+        return decision_tree_step(node, answer);
+
+    int64_t val = 0;
+    auto end = answer.data() + answer.size();
+    auto res = std::from_chars(answer.data(), end, val);
+    if (res.ec != std::errc() || res.ptr != end) return nullptr;
+
+    return decision_tree_step(node, val);
+}
+
+static void tree_evaluation_push(TreeEvaluator& evaluator, TreeEvaluation* evaluation)
+{
+    std::lock_guard<std::mutex> lock(evaluator.mutex);
+    evaluator.ready.push_back(evaluation);
+    evaluator.signal.notify_all();
+}
+
+// steps as far as the known answers go, then fetches and suspends or finishes
+static void tree_evaluation_run(TreeEvaluation* evaluation)
+{
+    TreeEvaluator& evaluator = *evaluation->evaluator;
+
+    const TreeNode* node = evaluation->node;
+    while (node && node->type != NodeType::FINAL)
+    {
+        if (node->type != NodeType::DECISION && node->type != NodeType::OPTION)
+        {
+            node = nullptr;
+            break;
+        }
+
+        const std::string* answer = tree_evaluation_answer(evaluation, node->name);
+        if (!answer)
+        {
+            // the provider may resume right away on another thread,
+            // the evaluation must not be touched after this call
+            evaluation->node = node;
+            evaluator.fetch(evaluation, node->name, evaluator.context);
+            return;
+        }
+
+        node = tree_evaluation_step(node, *answer);
+    }
+
+    evaluation->node = node;
+    evaluation->done(evaluation, node, evaluation->user);
+
+    std::lock_guard<std::mutex> lock(evaluator.mutex);
+    evaluator.active--;
+    evaluator.signal.notify_all();
+}
+
+static void tree_evaluator_work(TreeEvaluator* evaluator)
+{
+    for (;;)
+    {
+        TreeEvaluation* evaluation;
+        {
+            std::unique_lock<std::mutex> lock(evaluator->mutex);
+            evaluator->signal.wait(lock, [&] { return evaluator->stopping || !evaluator->ready.empty(); });
+            if (evaluator->ready.empty()) return;
+
+            evaluation = evaluator->ready.front();
+            evaluator->ready.pop_front();
+        }
+
+        tree_evaluation_run(evaluation);
+    }
+}
+
+void tree_evaluator_start(TreeEvaluator& evaluator, size_t threads, TreeFetchFn fetch, void* context)
+{
+    evaluator.fetch = fetch;
+    evaluator.context = context;
+    evaluator.active = 0;
+    evaluator.stopping = false;
+
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i)
+        evaluator.workers.emplace_back(tree_evaluator_work, &evaluator);
+}
+
+void tree_evaluator_stop(TreeEvaluator& evaluator)
+{
+    {
+        std::unique_lock<std::mutex> lock(evaluator.mutex);
+        evaluator.signal.wait(lock, [&] { return evaluator.active == 0; });
+
+        evaluator.stopping = true;
+        evaluator.signal.notify_all();
+    }
+
+    for (auto& worker : evaluator.workers)
+        worker.join();
+    evaluator.workers.clear();
+}
+
+void tree_evaluation_start(TreeEvaluator& evaluator, TreeEvaluation* evaluation, const TreeNode& root, TreeDoneFn done, void* user)
+{
+    evaluation->evaluator = &evaluator;
+    evaluation->node = &root;
+    evaluation->answers.clear();
+    evaluation->done = done;
+    evaluation->user = user;
+
+    std::lock_guard<std::mutex> lock(evaluator.mutex);
+    evaluator.active++;
+    evaluator.ready.push_back(evaluation);
+    evaluator.signal.notify_all();
+}
+
+void tree_evaluation_resume(TreeEvaluation* evaluation, std::string_view answer)
+{
+    evaluation->answers.emplace_back(&evaluation->node->name, std::string(answer));
+    tree_evaluation_push(*evaluation->evaluator, evaluation);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "tree.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// ------------------------------------------------------------------------
+// lazy evaluation
+// ------------------------------------------------------------------------
+// Walks many trees at once with answers fetched on demand. When a walk
+// reaches a decision or option node it asks the provider for that node's
+// variable and suspends. The provider answers whenever the value is ready,
+// from any thread, through tree_evaluation_resume. That puts the walk back
+// on the ready queue, and one of the few worker threads continues it. So
+// only the variables on the path taken are fetched (each one once per
+// walk), and the fetch latencies of all pending walks overlap.
+struct TreeEvaluation;
+struct TreeEvaluator;
+
+// start fetching the value of a variable, answer later with tree_evaluation_resume
+typedef void (*TreeFetchFn)(TreeEvaluation* evaluation, const std::string& name, void* context);
+
+// the walk ended, result is the final node or nullptr
+typedef void (*TreeDoneFn)(TreeEvaluation* evaluation, const TreeNode* result, void* user);
+
+struct TreeEvaluation
+{
+    TreeEvaluator* evaluator;
+    const TreeNode* node;
+
+    // answers fetched so far, a variable can occur more than once on a path
+    std::vector<std::pair<const std::string*, std::string>> answers;
+
+    TreeDoneFn done;
+    void* user;
+};
+
+struct TreeEvaluator
+{
+    TreeFetchFn fetch;
+    void* context;
+
+    std::mutex mutex;
+    std::condition_variable signal;
+    std::deque<TreeEvaluation*> ready;
+    size_t active;
+    bool stopping;
+
+    std::vector<std::thread> workers;
+};
+
+void tree_evaluator_start(TreeEvaluator& evaluator, size_t threads, TreeFetchFn fetch, void* context);
+
+// waits for all started walks to finish, then joins the workers
+void tree_evaluator_stop(TreeEvaluator& evaluator);
+
+// the evaluation has to stay alive until done was called
+void tree_evaluation_start(TreeEvaluator& evaluator, TreeEvaluation* evaluation, const TreeNode& root, TreeDoneFn done, void* user);
+
+void tree_evaluation_resume(TreeEvaluation* evaluation, std::string_view answer);
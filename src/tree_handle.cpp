@@ -0,0 +1,216 @@
+#include "tree_handle.h"
+
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+int tree_handle_open(TreeHandle& handle, const char* filename)
+{
+    handle.filename = filename;
+    handle.index = 0;
+    handle.slots[0] = nullptr;
+    handle.slots[1] = nullptr;
+    handle.readers[0] = 0;
+    handle.readers[1] = 0;
+
+    TreeWalker* walker = new TreeWalker();
+    if (!tree_walker_load(*walker, filename, TreeWalkerText::LAZY))
+    {
+        delete walker;
+        return 0;
+    }
+
+    handle.slots[0] = walker;
+    return 1;
+}
+
+void tree_handle_close(TreeHandle& handle)
+{
+    tree_handle_unwatch(handle);
+
+    std::lock_guard<std::mutex> lock(handle.reload_mutex);
+    for (int i = 0; i < 2; ++i)
+    {
+        while (handle.readers[i].load() != 0) std::this_thread::yield();
+        delete handle.slots[i].exchange(nullptr);
+    }
+}
+
+int tree_handle_reload(TreeHandle& handle)
+{
+    // parse and validate outside of the published slots
+    TreeWalker* walker = new TreeWalker();
+    if (!tree_walker_load(*walker, handle.filename.c_str(), TreeWalkerText::LAZY))
+    {
+        std::cout << "[Warn] Keeping previous version of " << handle.filename << "\n";
+        delete walker;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(handle.reload_mutex);
+
+    int old = handle.index.load();
+    int next = old ^ 1;
+
+    // the next slot was drained by the previous reload, readers that still
+    // bump its counter with a stale index back off before dereferencing
+    handle.slots[next].store(walker);
+    handle.index.store(next);
+
+    // wait for in-flight evaluations on the old version
+    while (handle.readers[old].load() != 0) std::this_thread::yield();
+    delete handle.slots[old].exchange(nullptr);
+
+    return 1;
+}
+
+// fallback where inotify isn't available
+static void tree_handle_poll_loop(TreeHandle* handle, int interval_ms)
+{
+    std::error_code error;
+    auto last_write = std::filesystem::last_write_time(handle->filename, error);
+
+    std::unique_lock<std::mutex> lock(handle->watch_mutex);
+    while (handle->watching)
+    {
+        handle->watch_signal.wait_for(lock, std::chrono::milliseconds(interval_ms));
+        if (!handle->watching) break;
+
+        auto write = std::filesystem::last_write_time(handle->filename, error);
+        if (error || write == last_write) continue;
+
+        last_write = write;
+
+        lock.unlock();
+        tree_handle_reload(*handle);
+        lock.lock();
+    }
+}
+
+#ifdef __linux__
+static bool tree_handle_watching(TreeHandle* handle)
+{
+    std::lock_guard<std::mutex> lock(handle->watch_mutex);
+    return handle->watching;
+}
+
+// Watch the directory rather than the file, editors and deploy scripts
+// often replace the file by renaming a new one over it. A reload happens
+// once a writer closed the file or a file was moved onto its name.
+static void tree_handle_watch_loop(TreeHandle* handle, int interval_ms)
+{
+    std::filesystem::path path = std::filesystem::absolute(handle->filename);
+    std::string name = path.filename().string();
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, path.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        std::cout << "[warn] Can't watch " << handle->filename << " with inotify, polling instead.\n";
+        if (fd >= 0) close(fd);
+        tree_handle_poll_loop(handle, interval_ms);
+        return;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { handle->wake, POLLIN, 0 } };
+
+    while (tree_handle_watching(handle))
+    {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (!tree_handle_watching(handle)) break;
+
+        bool changed = false;
+        ssize_t size;
+        while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* pos = buffer; pos < buffer + size;)
+            {
+                const inotify_event* event = (const inotify_event*)pos;
+                if (event->len && name == event->name) changed = true;
+                pos += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        if (changed) tree_handle_reload(*handle);
+    }
+
+    close(fd);
+}
+#else
+static void tree_handle_watch_loop(TreeHandle* handle, int interval_ms)
+{
+    tree_handle_poll_loop(handle, interval_ms);
+}
+#endif
+
+int tree_handle_watch(TreeHandle& handle, int interval_ms)
+{
+    std::lock_guard<std::mutex> lock(handle.watch_mutex);
+    if (handle.watching) return 0;
+
+#ifdef __linux__
+    handle.wake = eventfd(0, EFD_CLOEXEC);
+    if (handle.wake < 0)
+    {
+        std::cout << "[Error] Failed to create the watcher of " << handle.filename << "\n";
+        return 0;
+    }
+#endif
+
+    handle.watching = true;
+    handle.watcher = std::thread(tree_handle_watch_loop, &handle, interval_ms);
+    return 1;
+}
+
+void tree_handle_unwatch(TreeHandle& handle)
+{
+    {
+        std::lock_guard<std::mutex> lock(handle.watch_mutex);
+        handle.watching = false;
+    }
+    handle.watch_signal.notify_all();
+
+#ifdef __linux__
+    if (handle.wake >= 0)
+    {
+        uint64_t one = 1;
+        if (write(handle.wake, &one, sizeof(one)) != sizeof(one))
+            std::cout << "[warn] Failed to wake the watcher of " << handle.filename << "\n";
+    }
+#endif
+
+    if (handle.watcher.joinable())
+        handle.watcher.join();
+
+#ifdef __linux__
+    if (handle.wake >= 0) close(handle.wake);
+    handle.wake = -1;
+#endif
+}
+
+TreeVersion tree_handle_acquire(TreeHandle& handle)
+{
+    for (;;)
+    {
+        int slot = handle.index.load();
+        handle.readers[slot].fetch_add(1);
+
+        // the index did not move while pinning, so the slot can't be freed
+        if (handle.index.load() == slot)
+            return { handle.slots[slot].load(), slot };
+
+        handle.readers[slot].fetch_sub(1);
+    }
+}
+
+void tree_handle_release(TreeHandle& handle, TreeVersion version)
+{
+    handle.readers[version.slot].fetch_sub(1);
+}
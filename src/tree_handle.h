@@ -0,0 +1,55 @@
+#pragma once
+
+#include "tree_walker.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// ------------------------------------------------------------------------
+// reloadable tree handle
+// ------------------------------------------------------------------------
+// A TreeHandle publishes immutable TreeWalker versions. Readers pin the
+// current version by bumping the reader count of its slot (no locks, no
+// waiting). A reload parses into the other slot, flips the index and waits
+// until the readers of the old slot drained before freeing it.
+struct TreeHandle
+{
+    std::string filename;
+
+    std::atomic<int> index;
+    std::atomic<TreeWalker*> slots[2];
+    std::atomic<int> readers[2];
+
+    // serializes reloads (writers only)
+    std::mutex reload_mutex;
+
+    // file watcher, inotify on linux and polling elsewhere
+    std::thread watcher;
+    std::mutex watch_mutex;
+    std::condition_variable watch_signal;
+    bool watching = false;
+    int wake = -1;      // eventfd that stops the inotify watcher
+};
+
+struct TreeVersion
+{
+    const TreeWalker* walker;
+    int slot;
+};
+
+int  tree_handle_open(TreeHandle& handle, const char* filename);
+void tree_handle_close(TreeHandle& handle);
+
+// reparse the file and publish it, keeps the old version on failure
+int tree_handle_reload(TreeHandle& handle);
+
+// watch the file for changes and reload it in the background, interval_ms
+// is only used where the file has to be polled
+int  tree_handle_watch(TreeHandle& handle, int interval_ms);
+void tree_handle_unwatch(TreeHandle& handle);
+
+// pin the current version, has to be released with tree_handle_release
+TreeVersion tree_handle_acquire(TreeHandle& handle);
+void tree_handle_release(TreeHandle& handle, TreeVersion version);
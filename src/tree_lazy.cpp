@@ -0,0 +1,328 @@
+#include "tree_lazy.h"
+#include "tree_scan.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ------------------------------------------------------------------------
+// file
+// ------------------------------------------------------------------------
+#ifdef __linux__
+static const char* tree_lazy_map(const char* filename, size_t& size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat info;
+    void* text = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        text = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (text == MAP_FAILED) return nullptr;
+
+    size = (size_t)info.st_size;
+    return (const char*)text;
+}
+
+static void tree_lazy_unmap(const char* text, size_t size)
+{
+    munmap((void*)text, size);
+}
+
+// drop the pages fully inside the range, they are read again if needed
+static void tree_lazy_release(const TreeLazy& tree, size_t begin, size_t end)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t first = (begin + page - 1) / page * page;
+    size_t last = end / page * page;
+    if (first < last) madvise((void*)(tree.text + first), last - first, MADV_DONTNEED);
+}
+#else
+static const char* tree_lazy_map(const char* filename, size_t& size)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file) return nullptr;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* text = length > 0 ? new char[length] : nullptr;
+    if (text && fread(text, 1, length, file) != (size_t)length)
+    {
+        delete[] text;
+        text = nullptr;
+    }
+    fclose(file);
+
+    size = (size_t)length;
+    return text;
+}
+
+static void tree_lazy_unmap(const char* text, size_t size)
+{
+    delete[] text;
+}
+
+static void tree_lazy_release(const TreeLazy& tree, size_t begin, size_t end) {}
+#endif
+
+// ------------------------------------------------------------------------
+// prescan
+// ------------------------------------------------------------------------
+// parse a start tag on its own, as if the element had no children
+static TreeNode tree_lazy_parse_tag(std::string_view tag, TreeScanTag kind, NodeType parent_type)
+{
+    tinyxml2::XMLDocument doc;
+    auto element = tree_scan_parse_tag(doc, tag, kind);
+    if (!element) return { NodeType::UNKNOWN };
+
+    return parse_tree_node(element, parent_type);
+}
+
+static int tree_lazy_prescan(TreeLazy& tree)
+{
+    std::string_view text(tree.text, tree.size);
+
+    size_t pos = 0;
+    int depth = 0;
+    int root_depth = -1;
+    size_t branch_begin = 0;
+    std::string_view branch_tag;
+
+    while ((pos = text.find('<', pos)) != std::string_view::npos)
+    {
+        TreeScanTag kind;
+        size_t end = tree_scan_tag(text, pos, kind);
+        if (end == std::string_view::npos)
+        {
+            printf("[Error] Unterminated tag at byte %zu.\n", pos);
+            return 0;
+        }
+
+        std::string_view tag = text.substr(pos, end - pos);
+        size_t branch_end = 0;
+
+        if (kind == TreeScanTag::OPEN || kind == TreeScanTag::EMPTY)
+        {
+            if (root_depth < 0)
+            {
+                // the first decision or option element, like tree_walker_load
+                NodeType type = parse_node_type(std::string(tree_scan_tag_name(tag)).c_str());
+                if (type == NodeType::DECISION || type == NodeType::OPTION)
+                {
+                    tree.root = tree_lazy_parse_tag(tag, kind, NodeType::UNKNOWN);
+                    tree.root.type = type;
+                    root_depth = depth;
+                    if (kind == TreeScanTag::EMPTY) break;
+                }
+            }
+            else if (depth == root_depth + 1)
+            {
+                branch_begin = pos;
+                branch_tag = tag;
+                if (kind == TreeScanTag::EMPTY) branch_end = end;
+            }
+
+            if (kind == TreeScanTag::OPEN) depth++;
+        }
+        else if (kind == TreeScanTag::CLOSE)
+        {
+            depth--;
+            if (root_depth >= 0 && depth == root_depth) break;
+            if (root_depth >= 0 && depth == root_depth + 1) branch_end = end;
+        }
+
+        if (branch_end)
+        {
+            TreeNode choice = tree_lazy_parse_tag(branch_tag, kind == TreeScanTag::EMPTY ? kind : TreeScanTag::OPEN, tree.root.type);
+
+            // ignore unknown nodes, like parse_choices
+            if (choice.type != NodeType::UNKNOWN)
+            {
+                tree.root.choices.push_back(std::move(choice));
+
+                TreeLazyBranch& branch = tree.branches.emplace_back();
+                branch.begin = branch_begin;
+                branch.end = branch_end;
+                branch.parsed = false;
+            }
+        }
+
+        pos = end;
+    }
+
+    if (root_depth < 0)
+    {
+        printf("[Error] Couldn't find a decision tree.\n");
+        return 0;
+    }
+
+    // valid nodes without choices are final, like parse_tree_node
+    if (tree.root.choices.empty())
+        tree.root.type = NodeType::FINAL;
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+// lazy tree
+// ------------------------------------------------------------------------
+int tree_lazy_open(TreeLazy& tree, const char* filename)
+{
+    tree.text = tree_lazy_map(filename, tree.size);
+    if (!tree.text)
+    {
+        printf("[Error] Failed to open file (%s).\n", filename);
+        return 0;
+    }
+
+    if (!tree_lazy_prescan(tree))
+    {
+        tree_lazy_close(tree);
+        return 0;
+    }
+
+    tree_lazy_release(tree, 0, tree.size);
+    return 1;
+}
+
+void tree_lazy_close(TreeLazy& tree)
+{
+    if (tree.text) tree_lazy_unmap(tree.text, tree.size);
+
+    tree.text = nullptr;
+    tree.size = 0;
+    tree.root = {};
+    tree.branches.clear();
+}
+
+static void tree_lazy_parse(TreeLazy& tree, size_t index)
+{
+    TreeLazyBranch& branch = tree.branches[index];
+
+    tinyxml2::XMLDocument doc;
+    if (doc.Parse(tree.text + branch.begin, branch.end - branch.begin) == tinyxml2::XML_SUCCESS && doc.RootElement())
+    {
+        branch.node = parse_tree_node(doc.RootElement(), tree.root.type);
+
+        NodeType type = parse_node_type(doc.RootElement()->Name());
+        if (type == NodeType::DECISION || type == NodeType::OPTION)
+            tree_walker_read_prompts(branch.symbols, branch.prompts, branch.text, doc.RootElement());
+    }
+    else
+    {
+        printf("[Error] Failed to parse the branch at byte %zu.\n", branch.begin);
+        branch.node = { NodeType::UNKNOWN, tree.root.choices[index].name };
+    }
+
+    // the value was checked by the prescan already
+    branch.node.value = tree.root.choices[index].value;
+
+    tree_lazy_release(tree, branch.begin, branch.end);
+    branch.parsed = true;
+}
+
+const TreeNode* tree_lazy_branch(TreeLazy& tree, size_t index)
+{
+    TreeLazyBranch& branch = tree.branches[index];
+    std::call_once(branch.once, tree_lazy_parse, std::ref(tree), index);
+    return &branch.node;
+}
+
+const TreeNode* tree_lazy_walk(TreeLazy& tree, const std::string_view* answers, size_t count)
+{
+    const TreeNode* choice = decision_tree_walk(&tree.root, answers, count ? 1 : 0);
+    if (!choice || choice == &tree.root) return choice;
+
+    const TreeNode* branch = tree_lazy_branch(tree, choice - tree.root.choices.data());
+    if (branch->type == NodeType::UNKNOWN) return nullptr;
+
+    return decision_tree_walk(branch, answers + 1, count - 1);
+}
+
+size_t tree_lazy_parsed(const TreeLazy& tree)
+{
+    size_t parsed = 0;
+    for (const auto& branch : tree.branches)
+        parsed += branch.parsed ? 1 : 0;
+    return parsed;
+}
+
+// ------------------------------------------------------------------------
+// parallel load
+// ------------------------------------------------------------------------
+int tree_lazy_load(TreeWalker& walker, const char* filename, size_t threads)
+{
+    TreeLazy lazy;
+    if (!tree_lazy_open(lazy, filename))
+        return 0;
+
+    // everything but the branches: the root with its prompt, the intro and the results
+    std::string shell;
+    size_t pos = 0;
+    for (const auto& branch : lazy.branches)
+    {
+        shell.append(lazy.text + pos, branch.begin - pos);
+        pos = branch.end;
+    }
+    shell.append(lazy.text + pos, lazy.size - pos);
+
+    tinyxml2::XMLDocument doc;
+    if (doc.Parse(shell.data(), shell.size()) != tinyxml2::XML_SUCCESS || !tree_walker_read(walker, doc, filename))
+    {
+        printf("[Error] Failed to parse file (%s).\n", filename);
+        tree_lazy_close(lazy);
+        return 0;
+    }
+
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    threads = std::max<size_t>(1, std::min(threads, lazy.branches.size()));
+
+    std::atomic<size_t> next = 0;
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < lazy.branches.size(); i = next++)
+            tree_lazy_branch(lazy, i);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(work);
+    work();
+
+    for (auto& worker : workers)
+        worker.join();
+
+    int result = 1;
+    walker.root = std::move(lazy.root);
+    for (size_t i = 0; i < lazy.branches.size(); ++i)
+    {
+        TreeLazyBranch& branch = lazy.branches[i];
+        if (branch.node.type == NodeType::UNKNOWN) result = 0;
+
+        walker.root.choices[i] = std::move(branch.node);
+
+        // the first prompt of a name wins, like tree_walker_read_prompts
+        for (const auto& entry : branch.prompts)
+        {
+            std::string_view name = symbol_pool_get(branch.symbols, entry.symbol);
+            if (!tree_text_find(walker.prompts, symbol_pool_find(*walker.symbols, name)))
+                tree_walker_set_prompt(walker, name, std::string_view(branch.text).substr(entry.text.offset, entry.text.length));
+        }
+    }
+
+    tree_lazy_close(lazy);
+    return result;
+}
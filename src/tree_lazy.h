@@ -0,0 +1,58 @@
+#pragma once
+
+#include "tree_walker.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+// ------------------------------------------------------------------------
+// lazy trees
+// ------------------------------------------------------------------------
+// Opens a tree file without parsing it. A prescan finds the byte range of
+// every choice of the root (a branch) and reads only their start tags, so
+// the root can be stepped through. A branch is parsed the first time a walk
+// reaches it, once, no matter how many threads get there at the same time.
+//
+// The file is mapped read only. Its pages are handed back after the prescan
+// and after parsing a branch, so only the parsed branches stay resident.
+// A branch brings its own prompts, results and the intro are only read by
+// tree_lazy_load.
+struct TreeLazyBranch
+{
+    size_t begin;       // byte range of the element in the file
+    size_t end;
+
+    std::once_flag once;
+    std::atomic<bool> parsed;
+    TreeNode node;
+    SymbolPool symbols;                     // names of the prompts
+    TreeTextTable prompts;
+    std::string text;                       // the prompts refer to this, not the walker's blob
+};
+
+struct TreeLazy
+{
+    const char* text = nullptr;
+    size_t size = 0;
+
+    // the choices of the root are parsed without anything below them
+    TreeNode root;
+    std::deque<TreeLazyBranch> branches;
+};
+
+int tree_lazy_open(TreeLazy& tree, const char* filename);
+void tree_lazy_close(TreeLazy& tree);
+
+// the full choice index of the root, parsed on first use
+const TreeNode* tree_lazy_branch(TreeLazy& tree, size_t index);
+
+// like decision_tree_walk
+const TreeNode* tree_lazy_walk(TreeLazy& tree, const std::string_view* answers, size_t count);
+
+size_t tree_lazy_parsed(const TreeLazy& tree);
+
+// Load the whole tree into walker like tree_walker_load, parsing the branches
+// on up to threads threads (0 for one per core). The branches are merged in
+// file order, so the result is the same for any number of threads.
+int tree_lazy_load(TreeWalker& walker, const char* filename, size_t threads);
@@ -0,0 +1,249 @@
+#include "tree_memory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+// unordered_map node: next link, the pair, then the cached hash
+#define TREE_MEMORY_HASH_NODE (sizeof(void*) + sizeof(std::pair<std::string_view, uint32_t>) + sizeof(size_t))
+
+// libstdc++ deques allocate blocks of 512 bytes and a map of at least 8 block pointers
+#define TREE_MEMORY_DEQUE_BLOCK 512
+
+// make_shared puts the object after the vtable pointer and both use counts
+#define TREE_MEMORY_SHARED (sizeof(void*) + 2 * sizeof(int))
+
+// libstdc++ keeps up to 15 characters inside the string object
+#define TREE_MEMORY_SSO 15
+
+// chunk size of a glibc malloc allocation
+static size_t tree_memory_chunk(size_t size)
+{
+    size_t chunk = (size + 8 + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+static void tree_memory_alloc(TreeMemoryUsage& usage, size_t size)
+{
+    if (!size) return;
+
+    usage.bytes += size;
+    usage.heap += tree_memory_chunk(size);
+    usage.allocations++;
+}
+
+// memory inside an object counted elsewhere
+static void tree_memory_inline(TreeMemoryUsage& usage, size_t size)
+{
+    usage.bytes += size;
+    usage.heap += size;
+}
+
+static void tree_memory_string(TreeMemoryUsage& usage, const std::string& str)
+{
+    if (str.capacity() > TREE_MEMORY_SSO)
+        tree_memory_alloc(usage, str.capacity() + 1);
+}
+
+static void tree_memory_table(TreeMemoryUsage& usage, const TreeTextTable& table)
+{
+    tree_memory_inline(usage, sizeof(table));
+    tree_memory_alloc(usage, table.capacity() * sizeof(TreeTextEntry));
+}
+
+static void tree_memory_symbols(TreeMemoryUsage& usage, const TreeWalker& walker)
+{
+    tree_memory_inline(usage, sizeof(walker.symbols));
+    if (!walker.symbols) return;
+
+    const SymbolPool& symbols = *walker.symbols;
+    tree_memory_alloc(usage, TREE_MEMORY_SHARED + sizeof(SymbolPool));
+
+    size_t blocks = symbols.strings.size() / (TREE_MEMORY_DEQUE_BLOCK / sizeof(std::string)) + 1;
+    for (size_t i = 0; i < blocks; ++i)
+        tree_memory_alloc(usage, TREE_MEMORY_DEQUE_BLOCK);
+    tree_memory_alloc(usage, std::max<size_t>(8, blocks + 2) * sizeof(void*));
+
+    for (const auto& str : symbols.strings)
+    {
+        tree_memory_string(usage, str);
+        tree_memory_alloc(usage, TREE_MEMORY_HASH_NODE);
+    }
+
+    // a single bucket lives inside the map
+    if (symbols.ids.bucket_count() > 1)
+        tree_memory_alloc(usage, symbols.ids.bucket_count() * sizeof(void*));
+}
+
+static void tree_memory_text(TreeMemoryUsage& usage, const TreeWalker& walker)
+{
+    tree_memory_inline(usage, sizeof(walker.intro) + sizeof(walker.text) + sizeof(walker.source));
+    tree_memory_string(usage, walker.text);
+
+    if (!walker.source) return;
+
+    const TreeTextSource& source = *walker.source;
+    tree_memory_alloc(usage, TREE_MEMORY_SHARED + sizeof(TreeTextSource));
+    tree_memory_string(usage, source.filename);
+    if (source.loaded) tree_memory_string(usage, source.text);
+}
+
+static void tree_memory_nodes(TreeMemory& memory, const TreeNode& root)
+{
+    TreeMemoryUsage& nodes = memory.parts[(size_t)TreeMemoryPart::NODES];
+    TreeMemoryUsage& names = memory.parts[(size_t)TreeMemoryPart::NAMES];
+    TreeMemoryUsage& values = memory.parts[(size_t)TreeMemoryPart::VALUES];
+
+    // the root lives in the walker, every other node in its parent's vector
+    tree_memory_inline(nodes, sizeof(TreeNode));
+
+    std::vector<const TreeNode*> stack = { &root };
+    while (!stack.empty())
+    {
+        const TreeNode* node = stack.back();
+        stack.pop_back();
+
+        tree_memory_string(names, node->name);
+
+        if (auto str = std::get_if<std::string>(&node->value))
+            tree_memory_string(values, *str);
+        else if (auto expr = std::get_if<DecisionExpr>(&node->value))
+            tree_memory_alloc(values, expr->set.capacity() * sizeof(DecisionInterval));
+
+        tree_memory_alloc(nodes, node->choices.capacity() * sizeof(TreeNode));
+        for (const auto& choice : node->choices)
+            stack.push_back(&choice);
+    }
+}
+
+void tree_memory_walker(TreeMemory& memory, const TreeWalker& walker)
+{
+    tree_memory_nodes(memory, walker.root);
+    tree_memory_table(memory.parts[(size_t)TreeMemoryPart::PROMPTS], walker.prompts);
+    tree_memory_table(memory.parts[(size_t)TreeMemoryPart::RESULTS], walker.results);
+    tree_memory_symbols(memory.parts[(size_t)TreeMemoryPart::SYMBOLS], walker);
+    tree_memory_text(memory.parts[(size_t)TreeMemoryPart::TEXT], walker);
+}
+
+// ------------------------------------------------------------------------
+// dom
+// ------------------------------------------------------------------------
+// tinyxml2 takes nodes from pools of 4 KB blocks (MemPoolT), the pointers to
+// the blocks past the first 10 live in a growing array
+static void tree_memory_pool(TreeMemoryUsage& usage, size_t item_size, size_t items)
+{
+    size_t per_block = 4096 / item_size;
+    size_t blocks = (items + per_block - 1) / per_block;
+    for (size_t i = 0; i < blocks; ++i)
+        tree_memory_alloc(usage, per_block * item_size);
+
+    size_t capacity = 10;
+    while (capacity < blocks) capacity *= 2;
+    if (capacity > 10) tree_memory_alloc(usage, capacity * sizeof(void*));
+}
+
+// the document parses in place, in a copy of the whole file
+static void tree_memory_dom(TreeMemoryUsage& usage, const tinyxml2::XMLDocument& doc, size_t file_size)
+{
+    tree_memory_alloc(usage, file_size + 1);
+
+    // every closing tag briefly takes an element from the pool
+    size_t elements = 1, attributes = 0, texts = 0, others = 0;
+
+    std::vector<const tinyxml2::XMLNode*> stack;
+    for (auto child = doc.FirstChild(); child; child = child->NextSibling())
+        stack.push_back(child);
+
+    while (!stack.empty())
+    {
+        const tinyxml2::XMLNode* node = stack.back();
+        stack.pop_back();
+
+        if (auto element = node->ToElement())
+        {
+            elements++;
+            for (auto attribute = element->FirstAttribute(); attribute; attribute = attribute->Next())
+                attributes++;
+        }
+        else if (node->ToText())
+            texts++;
+        else
+            others++;
+
+        for (auto child = node->FirstChild(); child; child = child->NextSibling())
+            stack.push_back(child);
+    }
+
+    tree_memory_pool(usage, sizeof(tinyxml2::XMLElement), elements);
+    tree_memory_pool(usage, sizeof(tinyxml2::XMLAttribute), attributes);
+    tree_memory_pool(usage, sizeof(tinyxml2::XMLText), texts);
+    tree_memory_pool(usage, sizeof(tinyxml2::XMLComment), others);
+}
+
+int tree_memory_load(TreeMemory& memory, TreeWalker& walker, const char* filename, TreeWalkerText text)
+{
+    tinyxml2::XMLDocument doc;
+    auto result = doc.LoadFile(filename);
+    if (result != tinyxml2::XML_SUCCESS)
+    {
+        std::cout << "[Error] Failed to open file (" << filename << "). (" << result << ")\n";
+        return 0;
+    }
+
+    if (!tree_walker_read(walker, doc, filename, text))
+        return 0;
+
+    std::error_code error;
+    size_t file_size = (size_t)std::filesystem::file_size(filename, error);
+    tree_memory_dom(memory.parts[(size_t)TreeMemoryPart::DOM], doc, error ? 0 : file_size);
+
+    tree_memory_walker(memory, walker);
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+// report
+// ------------------------------------------------------------------------
+TreeMemoryUsage tree_memory_total(const TreeMemory& memory)
+{
+    TreeMemoryUsage total = {};
+    for (size_t i = 0; i < (size_t)TreeMemoryPart::DOM; ++i)
+    {
+        total.bytes += memory.parts[i].bytes;
+        total.heap += memory.parts[i].heap;
+        total.allocations += memory.parts[i].allocations;
+    }
+    return total;
+}
+
+const char* tree_memory_part_name(TreeMemoryPart part)
+{
+    switch (part)
+    {
+    case TreeMemoryPart::NODES:   return "nodes";
+    case TreeMemoryPart::NAMES:   return "names";
+    case TreeMemoryPart::VALUES:  return "values";
+    case TreeMemoryPart::PROMPTS: return "prompts";
+    case TreeMemoryPart::RESULTS: return "results";
+    case TreeMemoryPart::SYMBOLS: return "symbols";
+    case TreeMemoryPart::TEXT:    return "text";
+    case TreeMemoryPart::DOM:     return "dom";
+    default:                      return "";
+    }
+}
+
+static void tree_memory_print_usage(const char* label, const TreeMemoryUsage& usage)
+{
+    printf("  %-16s %14zu %14zu %12zu\n", label, usage.bytes, usage.heap, usage.allocations);
+}
+
+void tree_memory_print(const TreeMemory& memory)
+{
+    printf("  %-16s %14s %14s %12s\n", "", "bytes", "heap", "allocations");
+    for (size_t i = 0; i < (size_t)TreeMemoryPart::DOM; ++i)
+        tree_memory_print_usage(tree_memory_part_name((TreeMemoryPart)i), memory.parts[i]);
+
+    tree_memory_print_usage("total", tree_memory_total(memory));
+    tree_memory_print_usage("dom (load only)", memory.parts[(size_t)TreeMemoryPart::DOM]);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "tree_walker.h"
+
+// ------------------------------------------------------------------------
+// memory accounting
+// ------------------------------------------------------------------------
+// Bytes and heap allocations of a loaded tree by component. bytes is what
+// the containers hold including unused capacity, heap adds the allocator's
+// chunk overhead (glibc malloc on 64 bit: 8 byte header, 16 byte rounding,
+// 32 byte minimum), which is what a server actually pays. Strings short
+// enough for the small string buffer don't allocate and only count their
+// sizeof.
+//
+// The walker itself is split up: the root node counts towards NODES, the
+// tables from name symbols to text references towards PROMPTS and RESULTS,
+// the pool holding those names towards SYMBOLS, the text blob with the
+// intro reference towards TEXT. Lazy text only counts once it has been
+// read. A pool shared by several walkers counts for each of them.
+// DOM is the tinyxml2 document while loading, freed once the tree is read.
+enum class TreeMemoryPart
+{
+    NODES,      // TreeNode objects and the choice vectors holding them
+    NAMES,      // node name strings
+    VALUES,     // option value strings and expression interval sets
+    PROMPTS,    // symbols and references, the text is in TEXT
+    RESULTS,
+    SYMBOLS,    // names of the prompts and results
+    TEXT,       // blob of the intro, prompts and results
+    DOM,
+    COUNT
+};
+
+struct TreeMemoryUsage
+{
+    size_t bytes;
+    size_t heap;
+    size_t allocations;
+};
+
+struct TreeMemory
+{
+    TreeMemoryUsage parts[(size_t)TreeMemoryPart::COUNT];
+};
+
+// add the usage of a loaded walker, DOM is left untouched
+void tree_memory_walker(TreeMemory& memory, const TreeWalker& walker);
+
+// load the walker and add its usage including the DOM while loading
+int tree_memory_load(TreeMemory& memory, TreeWalker& walker, const char* filename, TreeWalkerText text = TreeWalkerText::ALL);
+
+// total of the parts that stay once loaded, without DOM
+TreeMemoryUsage tree_memory_total(const TreeMemory& memory);
+
+const char* tree_memory_part_name(TreeMemoryPart part);
+
+void tree_memory_print(const TreeMemory& memory);
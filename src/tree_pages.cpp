@@ -0,0 +1,101 @@
+#include "tree_pages.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <new>
+
+#define TREE_PAGES_HUGE (2u << 20)
+
+static TreePageOptions tree_pages_options;
+
+void tree_pages_configure(const TreePageOptions& options)
+{
+    tree_pages_options = options;
+}
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t tree_pages_length(size_t bytes)
+{
+    return (bytes + TREE_PAGES_HUGE - 1) & ~(size_t)(TREE_PAGES_HUGE - 1);
+}
+
+// anonymous mapping aligned to the huge page size
+static void* tree_pages_map_aligned(size_t length)
+{
+    char* raw = (char*)mmap(nullptr, length + TREE_PAGES_HUGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+
+    char* ptr = (char*)(((uintptr_t)raw + TREE_PAGES_HUGE - 1) & ~(uintptr_t)(TREE_PAGES_HUGE - 1));
+    if (ptr > raw) munmap(raw, ptr - raw);
+    munmap(ptr + length, raw + TREE_PAGES_HUGE - ptr);
+
+    return ptr;
+}
+
+void* tree_pages_alloc(size_t bytes)
+{
+    if (bytes < TREE_PAGES_HUGE) return ::operator new(bytes);
+
+    const TreePageOptions& options = tree_pages_options;
+    size_t length = tree_pages_length(bytes);
+
+    void* ptr = nullptr;
+    if (options.pages == TreePages::HUGETLB)
+    {
+        ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED)
+        {
+            static bool warned = false;
+            if (!warned) printf("[warn] No reserved huge pages, using transparent huge pages.\n");
+            warned = true;
+            ptr = nullptr;
+        }
+    }
+
+    if (!ptr)
+    {
+        ptr = tree_pages_map_aligned(length);
+        if (!ptr) throw std::bad_alloc();
+
+        if (options.pages != TreePages::DEFAULT)
+            madvise(ptr, length, MADV_HUGEPAGE);
+    }
+
+    if (options.prefault)
+    {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (size_t offset = 0; offset < bytes; offset += page)
+            ((volatile char*)ptr)[offset] = 0;
+    }
+
+    if (options.lock && mlock(ptr, bytes) != 0)
+    {
+        static bool warned = false;
+        if (!warned) printf("[warn] Failed to lock tree pages (RLIMIT_MEMLOCK).\n");
+        warned = true;
+    }
+
+    return ptr;
+}
+
+void tree_pages_free(void* ptr, size_t bytes)
+{
+    if (bytes < TREE_PAGES_HUGE)
+        ::operator delete(ptr);
+    else
+        munmap(ptr, tree_pages_length(bytes));
+}
+#else
+void* tree_pages_alloc(size_t bytes)
+{
+    return ::operator new(bytes);
+}
+
+void tree_pages_free(void* ptr, size_t bytes)
+{
+    ::operator delete(ptr);
+}
+#endif
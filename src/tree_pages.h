@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// ------------------------------------------------------------------------
+// huge page storage
+// ------------------------------------------------------------------------
+// Large tree arrays (2 MB and up) are mapped directly and 2 MB aligned, so
+// they can be backed by huge pages, which cuts the TLB misses of random
+// walks through big compiled trees. Smaller ones use the regular heap.
+//
+// HUGETLB takes pages from the reserved pool (vm.nr_hugepages) and falls
+// back to TRANSPARENT when that is empty. TRANSPARENT asks for transparent
+// huge pages through madvise. prefault touches every page on allocation and
+// lock mlocks them, so the first walks after building a tree don't take
+// page faults. The options apply to allocations made after setting them.
+// Huge pages, prefault and lock are linux only.
+enum class TreePages
+{
+    DEFAULT,
+    TRANSPARENT,
+    HUGETLB
+};
+
+struct TreePageOptions
+{
+    TreePages pages = TreePages::DEFAULT;
+    bool prefault = false;
+    bool lock = false;
+};
+
+void tree_pages_configure(const TreePageOptions& options);
+
+void* tree_pages_alloc(size_t bytes);
+void tree_pages_free(void* ptr, size_t bytes);
+
+template<typename T>
+struct TreePageAllocator
+{
+    typedef T value_type;
+
+    TreePageAllocator() = default;
+    template<typename U> TreePageAllocator(const TreePageAllocator<U>&) {}
+
+    T* allocate(size_t n) { return (T*)tree_pages_alloc(n * sizeof(T)); }
+    void deallocate(T* ptr, size_t n) { tree_pages_free(ptr, n * sizeof(T)); }
+
+    template<typename U> bool operator==(const TreePageAllocator<U>&) const { return true; }
+    template<typename U> bool operator!=(const TreePageAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using TreePageVector = std::vector<T, TreePageAllocator<T>>;
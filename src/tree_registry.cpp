@@ -0,0 +1,198 @@
+#include "tree_registry.h"
+#include "tree_memory.h"
+
+#include <cstdio>
+
+// heap footprint of a loaded tree without its pool, used for the memory budget
+static size_t tree_registry_bytes(const TreeRegistryTree& tree)
+{
+    TreeMemory memory = {};
+    tree_memory_walker(memory, tree.walker);
+
+    size_t bytes = tree_memory_total(memory).heap - memory.parts[(size_t)TreeMemoryPart::SYMBOLS].heap;
+    bytes += compiled_tree_bytes(tree.tree);
+
+    // the index is a node per feature plus the bucket array
+    const FeatureSet& features = tree.features;
+    bytes += features.symbols.capacity() * sizeof(uint32_t)
+        + features.types.capacity() * sizeof(NodeType)
+        + features.index.size() * (sizeof(void*) + 2 * sizeof(uint32_t) + sizeof(size_t))
+        + features.index.bucket_count() * sizeof(void*);
+
+    return bytes;
+}
+
+// evict least recently used trees until the budget fits, keeps the given entry
+static void tree_registry_evict(TreeRegistry& registry, uint32_t keep)
+{
+    while (registry.used > registry.budget)
+    {
+        uint32_t victim = TREE_REGISTRY_NONE;
+        for (uint32_t i = 0; i < registry.entries.size(); ++i)
+        {
+            const auto& entry = registry.entries[i];
+            if (i == keep || !entry.tree) continue;
+
+            if (victim == TREE_REGISTRY_NONE || entry.last_use < registry.entries[victim].last_use)
+                victim = i;
+        }
+
+        if (victim == TREE_REGISTRY_NONE) return;
+
+        auto& entry = registry.entries[victim];
+        registry.used -= entry.bytes;
+        entry.tree.reset();
+        entry.bytes = 0;
+    }
+}
+
+// read and compile a tree into the shared pool, evaluation doesn't need the
+// text so it's only read when asked for
+static std::shared_ptr<TreeRegistryTree> tree_registry_load(TreeRegistry& registry, const std::string& filename, size_t& bytes)
+{
+    auto loaded = std::make_shared<TreeRegistryTree>();
+    if (!tree_walker_load(loaded->walker, filename.c_str(), TreeWalkerText::LAZY))
+        return nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(registry.symbols_mutex);
+        if (!compiled_tree_build(loaded->tree, loaded->walker.root, *registry.symbols, loaded->features))
+        {
+            printf("[Error] Can't compile tree %s.\n", filename.c_str());
+            return nullptr;
+        }
+    }
+
+    // measured while the walker still has its own pool, which doesn't count
+    loaded->walker.root = {};
+    bytes = tree_registry_bytes(*loaded);
+
+    std::lock_guard<std::mutex> lock(registry.symbols_mutex);
+    tree_walker_rebase(loaded->walker, registry.symbols);
+
+    return loaded;
+}
+
+uint32_t tree_registry_add(TreeRegistry& registry, std::string_view id, const char* filename)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    uint32_t symbol;
+    {
+        std::lock_guard<std::mutex> symbols_lock(registry.symbols_mutex);
+        symbol = symbol_pool_intern(*registry.symbols, id);
+    }
+
+    if (symbol >= registry.slots.size())
+        registry.slots.resize(symbol + 1, TREE_REGISTRY_NONE);
+
+    uint32_t tree = registry.slots[symbol];
+    if (tree == TREE_REGISTRY_NONE)
+    {
+        tree = (uint32_t)registry.entries.size();
+        registry.entries.push_back({ filename, nullptr, 0, 0, false });
+        registry.slots[symbol] = tree;
+    }
+    else
+    {
+        // re-registering points the id to a new file, it gets loaded on next
+        // use, a load still running for the old file is dropped once done
+        auto& entry = registry.entries[tree];
+        registry.used -= entry.bytes;
+        entry = { filename, nullptr, 0, 0, entry.loading };
+    }
+
+    return tree;
+}
+
+uint32_t tree_registry_find(TreeRegistry& registry, std::string_view id)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    uint32_t symbol;
+    {
+        std::lock_guard<std::mutex> symbols_lock(registry.symbols_mutex);
+        symbol = symbol_pool_find(*registry.symbols, id);
+    }
+
+    if (symbol >= registry.slots.size()) return TREE_REGISTRY_NONE;
+
+    return registry.slots[symbol];
+}
+
+std::shared_ptr<const TreeRegistryTree> tree_registry_get(TreeRegistry& registry, uint32_t tree)
+{
+    std::string filename;
+    {
+        std::unique_lock<std::mutex> lock(registry.mutex);
+        if (tree >= registry.entries.size()) return nullptr;
+
+        // entries may grow while waiting, so index again after
+        registry.loaded.wait(lock, [&] { return !registry.entries[tree].loading; });
+
+        auto& entry = registry.entries[tree];
+        entry.last_use = ++registry.clock;
+        if (entry.tree) return entry.tree;
+
+        // a failed load leaves no tree, the next caller tries again
+        entry.loading = true;
+        filename = entry.filename;
+    }
+
+    // load without holding the lock, so lookups of other trees don't stall
+    size_t bytes = 0;
+    auto loaded = tree_registry_load(registry, filename, bytes);
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    auto& entry = registry.entries[tree];
+    entry.loading = false;
+    registry.loaded.notify_all();
+
+    // the id was re-registered, the caller still gets the tree it asked for
+    if (!loaded || entry.filename != filename) return loaded;
+
+    entry.tree = loaded;
+    entry.bytes = bytes;
+    registry.used += bytes;
+
+    tree_registry_evict(registry, tree);
+
+    return entry.tree;
+}
+
+void tree_registry_set_budget(TreeRegistry& registry, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    registry.budget = bytes;
+    tree_registry_evict(registry, TREE_REGISTRY_NONE);
+}
+
+uint32_t tree_registry_symbol(TreeRegistry& registry, std::string_view str)
+{
+    std::lock_guard<std::mutex> lock(registry.symbols_mutex);
+    return symbol_pool_find(*registry.symbols, str);
+}
+
+std::string_view tree_registry_name(TreeRegistry& registry, uint32_t symbol)
+{
+    std::lock_guard<std::mutex> lock(registry.symbols_mutex);
+    return symbol_pool_get(*registry.symbols, symbol);
+}
+
+static std::string_view tree_registry_find_text(TreeRegistry& registry, const TreeRegistryTree& tree, const TreeTextTable& table, std::string_view name)
+{
+    const TreeTextRef* ref = tree_text_find(table, tree_registry_symbol(registry, name));
+    return ref ? tree_walker_text(tree.walker, *ref) : std::string_view();
+}
+
+std::string_view tree_registry_prompt(TreeRegistry& registry, const TreeRegistryTree& tree, std::string_view name)
+{
+    return tree_registry_find_text(registry, tree, tree.walker.prompts, name);
+}
+
+std::string_view tree_registry_result(TreeRegistry& registry, const TreeRegistryTree& tree, std::string_view name)
+{
+    return tree_registry_find_text(registry, tree, tree.walker.results, name);
+}
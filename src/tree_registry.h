@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tree_walker.h"
+#include "compiled_tree.h"
+#include "symbol_pool.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+// ------------------------------------------------------------------------
+// tree registry
+// ------------------------------------------------------------------------
+// Holds many trees by id. Trees are only registered by file name and get
+// loaded on first use, callers asking for a tree that is being loaded wait
+// for that load. Once the loaded trees exceed the memory budget the least
+// recently used ones are evicted; evaluations that still hold a tree keep
+// it alive until they are done.
+//
+// Loaded trees are compiled, their TreeNodes are dropped. Tree ids, node
+// names, option values and the names of the prompts and results all live
+// in one pool shared by the registry, so names common to many trees are
+// stored once. The pool only grows, evicted trees leave their symbols
+// behind for the next load. Records are built with tree_registry_symbol and
+// texts read with tree_registry_prompt and tree_registry_result, the pool
+// and the tree_walker functions looking up names must not be used directly
+// while other threads load trees. The text tables themselves never change,
+// a node's text is found lock free by its name symbol with tree_text_find.
+#define TREE_REGISTRY_NONE UINT32_MAX
+
+struct TreeRegistryTree
+{
+    TreeWalker walker;      // lazy text only, the symbols are the registry's
+    CompiledTree tree;
+    FeatureSet features;
+};
+
+struct TreeRegistryEntry
+{
+    std::string filename;
+    std::shared_ptr<const TreeRegistryTree> tree;
+    size_t bytes;           // without the shared pool
+    uint64_t last_use;
+    bool loading;
+};
+
+struct TreeRegistry
+{
+    // shared by all trees of the registry, guarded by symbols_mutex
+    std::shared_ptr<SymbolPool> symbols = std::make_shared<SymbolPool>();
+    std::mutex symbols_mutex;
+
+    // entry index by symbol id of the tree id
+    std::vector<uint32_t> slots;
+    std::vector<TreeRegistryEntry> entries;
+
+    size_t budget = SIZE_MAX;
+    size_t used = 0;
+    uint64_t clock = 0;
+
+    // taken before symbols_mutex when both are needed
+    std::mutex mutex;
+    std::condition_variable loaded;
+};
+
+uint32_t tree_registry_add(TreeRegistry& registry, std::string_view id, const char* filename);
+uint32_t tree_registry_find(TreeRegistry& registry, std::string_view id);
+
+// loads the tree if necessary, returns nullptr if the file fails to load
+std::shared_ptr<const TreeRegistryTree> tree_registry_get(TreeRegistry& registry, uint32_t tree);
+
+void tree_registry_set_budget(TreeRegistry& registry, size_t bytes);
+
+// symbol id of a name or option value, SYMBOL_NONE if no tree uses it
+uint32_t tree_registry_symbol(TreeRegistry& registry, std::string_view str);
+
+// name of a symbol id, stays valid as long as the registry
+std::string_view tree_registry_name(TreeRegistry& registry, uint32_t symbol);
+
+// the text of a node name of a loaded tree, empty if it has none
+std::string_view tree_registry_prompt(TreeRegistry& registry, const TreeRegistryTree& tree, std::string_view name);
+std::string_view tree_registry_result(TreeRegistry& registry, const TreeRegistryTree& tree, std::string_view name);
@@ -0,0 +1,134 @@
+#include "tree_replica.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+
+static std::vector<int> numa_parse_list(const std::string& list)
+{
+    // e.g. "0-3,8-11"
+    std::vector<int> ids;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        char* end;
+        long first = strtol(list.c_str() + pos, &end, 10);
+        long last = *end == '-' ? strtol(end + 1, &end, 10) : first;
+        if (end == list.c_str() + pos) break;
+        for (long id = first; id <= last; ++id)
+            ids.push_back((int)id);
+
+        pos = end - list.c_str();
+        if (list[pos] != ',') break;
+        pos++;
+    }
+    return ids;
+}
+
+static std::string numa_read_line(const std::string& filename)
+{
+    std::string line;
+    std::ifstream file(filename);
+    std::getline(file, line);
+    return line;
+}
+
+std::vector<NumaNode> numa_nodes()
+{
+    // node ids can have gaps, e.g. "0,2-3"
+    std::vector<NumaNode> nodes;
+    for (int id : numa_parse_list(numa_read_line("/sys/devices/system/node/online")))
+    {
+        std::string list = numa_read_line("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+
+        // memory only nodes get no workers
+        auto cpus = numa_parse_list(list);
+        if (!cpus.empty()) nodes.push_back({ id, cpus });
+    }
+
+    if (nodes.empty())
+    {
+        nodes.push_back({ 0 });
+        for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+            nodes.back().cpus.push_back((int)cpu);
+    }
+    return nodes;
+}
+
+// pin the calling thread to the cpus of a node
+static void numa_pin(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        printf("[warn] Failed to pin thread to its node.\n");
+}
+#else
+std::vector<NumaNode> numa_nodes()
+{
+    std::vector<NumaNode> nodes = { { 0 } };
+    for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu)
+        nodes.back().cpus.push_back((int)cpu);
+    return nodes;
+}
+
+static void numa_pin(const std::vector<int>& cpus) {}
+#endif
+
+int tree_replicas_build(TreeReplicas& replicas, const CompiledTree& tree, const TreeWalker& walker, bool replicate)
+{
+    replicas.nodes = numa_nodes();
+    replicas.replicas.clear();
+    replicas.replicas.resize(replicate ? replicas.nodes.size() : 1);
+
+    // read lazy text once, before the copies
+    std::string_view text = tree_walker_blob(walker);
+
+    // copy every replica on its own node
+    for (size_t node = 0; node < replicas.replicas.size(); ++node)
+    {
+        TreeReplica* replica = &replicas.replicas[node];
+        replica->node = replicas.nodes[node].id;
+
+        const std::vector<int>* cpus = &replicas.nodes[node].cpus;
+        std::thread thread([=, &tree, &walker, &text]
+        {
+            numa_pin(*cpus);
+            replica->tree = tree;
+            replica->symbols = walker.symbols;
+            replica->prompts = walker.prompts;
+            replica->results = walker.results;
+            replica->text = text;
+        });
+        thread.join();
+    }
+    return 1;
+}
+
+void tree_replicas_run(const TreeReplicas& replicas, size_t threads, TreeReplicaWork work, void* user)
+{
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        size_t node = i % replicas.nodes.size();
+        const TreeReplica& replica = replicas.replicas[replicas.replicas.size() > 1 ? node : 0];
+
+        const std::vector<int>* cpus = &replicas.nodes[node].cpus;
+        workers.emplace_back([=, &replica]
+        {
+            numa_pin(*cpus);
+            work(replica, i, user);
+        });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+}
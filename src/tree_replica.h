@@ -0,0 +1,46 @@
+#pragma once
+
+#include "compiled_tree.h"
+#include "tree_walker.h"
+
+// ------------------------------------------------------------------------
+// numa replication
+// ------------------------------------------------------------------------
+// Keeps one copy of a compiled tree and its prompt/result tables per NUMA
+// node, the references point into the replica's own text. The names of the
+// tables stay in the walker's symbol pool, shared by all replicas. Each
+// replica is copied by a thread running on its node, so first touch places
+// its pages in local memory. Workers started through tree_replicas_run are
+// pinned round robin to the nodes and get their local replica. Node
+// discovery reads sysfs and pinning uses thread affinity, both linux only.
+// Elsewhere everything is one node.
+struct NumaNode
+{
+    int id;                 // as in /sys/devices/system/node/nodeN
+    std::vector<int> cpus;
+};
+
+struct TreeReplica
+{
+    int node;               // NumaNode id
+    CompiledTree tree;
+    std::shared_ptr<const SymbolPool> symbols;
+    TreeTextTable prompts;
+    TreeTextTable results;
+    std::string text;
+};
+
+struct TreeReplicas
+{
+    std::vector<NumaNode> nodes;            // nodes with cpus
+    std::vector<TreeReplica> replicas;      // one per node, or a single shared one
+};
+
+// every online node with cpus, a single node 0 with all cpus if unknown
+std::vector<NumaNode> numa_nodes();
+
+int tree_replicas_build(TreeReplicas& replicas, const CompiledTree& tree, const TreeWalker& walker, bool replicate);
+
+// runs threads workers, worker i on node i % nodes with the replica of that node
+typedef void (*TreeReplicaWork)(const TreeReplica& replica, size_t worker, void* user);
+void tree_replicas_run(const TreeReplicas& replicas, size_t threads, TreeReplicaWork work, void* user);
@@ -0,0 +1,56 @@
+#include "tree_scan.h"
+
+#include <cstring>
+
+size_t tree_scan_tag(std::string_view text, size_t pos, TreeScanTag& kind)
+{
+    auto skip = [&](const char* terminator) -> size_t
+    {
+        kind = TreeScanTag::OTHER;
+        size_t end = text.find(terminator, pos);
+        return end == std::string_view::npos ? end : end + strlen(terminator);
+    };
+
+    std::string_view rest = text.substr(pos);
+    if (rest.compare(0, 4, "<!--") == 0)      return skip("-->");
+    if (rest.compare(0, 9, "<![CDATA[") == 0) return skip("]]>");
+    if (rest.compare(0, 2, "<?") == 0)        return skip("?>");
+    if (rest.compare(0, 2, "<!") == 0)        return skip(">");
+
+    kind = rest.compare(0, 2, "</") == 0 ? TreeScanTag::CLOSE : TreeScanTag::OPEN;
+
+    // a '>' inside an attribute value doesn't end the tag
+    char quote = 0;
+    for (size_t i = pos + 1; i < text.size(); ++i)
+    {
+        char c = text[i];
+        if (quote)
+        {
+            if (c == quote) quote = 0;
+        }
+        else if (c == '"' || c == '\'')
+            quote = c;
+        else if (c == '>')
+        {
+            if (kind == TreeScanTag::OPEN && text[i - 1] == '/') kind = TreeScanTag::EMPTY;
+            return i + 1;
+        }
+    }
+    return std::string_view::npos;
+}
+
+std::string_view tree_scan_tag_name(std::string_view tag)
+{
+    size_t begin = tag[1] == '/' ? 2 : 1;
+    size_t end = tag.find_first_of(" \t\r\n/>", begin);
+    return tag.substr(begin, end - begin);
+}
+
+tinyxml2::XMLElement* tree_scan_parse_tag(tinyxml2::XMLDocument& doc, std::string_view tag, TreeScanTag kind)
+{
+    std::string element(tag);
+    if (kind == TreeScanTag::OPEN) element.insert(element.size() - 1, "/");
+
+    if (doc.Parse(element.data(), element.size()) != tinyxml2::XML_SUCCESS) return nullptr;
+    return doc.RootElement();
+}
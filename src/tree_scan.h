@@ -0,0 +1,28 @@
+#pragma once
+
+#include "tinyxml2/tinyxml2.h"
+
+#include <string>
+#include <string_view>
+
+// ------------------------------------------------------------------------
+// tag scanner
+// ------------------------------------------------------------------------
+// Finds the tags of an XML text without building a document, so parts of
+// a tree file can be read on their own. The elements found are parsed by
+// tinyxml2 one at a time.
+enum class TreeScanTag
+{
+    OPEN,
+    CLOSE,
+    EMPTY,
+    OTHER   // comments, CDATA, declarations
+};
+
+// end of the tag starting at pos, npos if it isn't terminated
+size_t tree_scan_tag(std::string_view text, size_t pos, TreeScanTag& kind);
+
+std::string_view tree_scan_tag_name(std::string_view tag);
+
+// parse a start tag on its own, as if the element had no children
+tinyxml2::XMLElement* tree_scan_parse_tag(tinyxml2::XMLDocument& doc, std::string_view tag, TreeScanTag kind);
@@ -0,0 +1,305 @@
+#include "tree_server.h"
+
+#include <iostream>
+
+void tree_server_add(TreeServerTrees& trees, std::string_view id, TreeHandle* handle)
+{
+    uint32_t symbol = symbol_pool_intern(trees.ids, id);
+    if (symbol == trees.handles.size())
+        trees.handles.push_back(handle);
+}
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TREE_SERVER_MAX_EVENTS  64
+#define TREE_SERVER_MAX_LINE    (64 * 1024)
+#define TREE_SERVER_READ_SIZE   (16 * 1024)
+#define TREE_SERVER_MAX_OUTPUT  (1024 * 1024)
+
+struct TreeConnection
+{
+    int fd;
+    std::string input;
+    std::string output;
+    size_t written;
+    uint32_t events;    // registered with epoll
+    bool eof;           // the client finished sending
+};
+
+static int tree_server_listen(const char* address)
+{
+    int fd = -1;
+    if (strncmp(address, "tcp:", 4) == 0)
+    {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons((uint16_t)atoi(address + 4));
+
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, address);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return -1;
+
+        unlink(address);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// evaluate one request line and append the response
+static void tree_server_eval(const TreeServerTrees& trees, std::string_view line, std::string& output)
+{
+    std::string_view tokens[TREE_SERVER_MAX_ANSWERS + 1];
+    size_t count = 0;
+
+    size_t pos = 0;
+    while (pos < line.size() && count <= TREE_SERVER_MAX_ANSWERS)
+    {
+        size_t start = line.find_first_not_of(" \t\r", pos);
+        if (start == std::string_view::npos) break;
+
+        size_t end = line.find_first_of(" \t\r", start);
+        if (end == std::string_view::npos) end = line.size();
+
+        tokens[count++] = line.substr(start, end - start);
+        pos = end;
+    }
+
+    if (count == 0) return;
+
+    // the client has to know its answers were not all used
+    if (count > TREE_SERVER_MAX_ANSWERS && line.find_first_not_of(" \t\r", pos) != std::string_view::npos)
+    {
+        output += "!\n";
+        return;
+    }
+
+    uint32_t id = symbol_pool_find(trees.ids, tokens[0]);
+    if (id == SYMBOL_NONE)
+    {
+        output += "?\n";
+        return;
+    }
+
+    TreeHandle* handle = trees.handles[id];
+    TreeVersion version = tree_handle_acquire(*handle);
+    const TreeNode* node = decision_tree_walk(&version.walker->root, tokens + 1, count - 1);
+
+    if (node && node->type == NodeType::FINAL)
+        output += node->name;
+    else
+        output += '-';
+    output += '\n';
+
+    tree_handle_release(*handle, version);
+}
+
+// answer all complete lines in the input buffer
+static int tree_server_process(const TreeServerTrees& trees, TreeConnection& conn)
+{
+    size_t start = 0;
+    size_t end;
+    while ((end = conn.input.find('\n', start)) != std::string::npos)
+    {
+        tree_server_eval(trees, std::string_view(conn.input).substr(start, end - start), conn.output);
+        start = end + 1;
+    }
+    conn.input.erase(0, start);
+
+    return conn.input.size() <= TREE_SERVER_MAX_LINE;
+}
+
+// returns 0 on error, otherwise sets pending if the socket would block
+static int tree_server_flush(TreeConnection& conn, bool& pending)
+{
+    while (conn.written < conn.output.size())
+    {
+        ssize_t n = send(conn.fd, conn.output.data() + conn.written, conn.output.size() - conn.written, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        conn.written += n;
+    }
+
+    pending = conn.written < conn.output.size();
+    if (!pending) conn.output.clear();
+    else          conn.output.erase(0, conn.written);
+
+    conn.written = 0;
+    return 1;
+}
+
+static void tree_server_close(int epoll_fd, TreeConnection* conn)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    delete conn;
+}
+
+static void tree_server_accept(int epoll_fd, int listen_fd)
+{
+    for (;;)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0) return;
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        TreeConnection* conn = new TreeConnection{ fd, "", "", 0, EPOLLIN, false };
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            delete conn;
+        }
+    }
+}
+
+// handle readiness of a connection, returns 0 if the connection should be closed
+static int tree_server_update(const TreeServerTrees& trees, int epoll_fd, TreeConnection* conn, uint32_t events)
+{
+    if (events & (EPOLLERR | EPOLLHUP)) return 0;
+
+    if (events & EPOLLIN)
+    {
+        char buffer[TREE_SERVER_READ_SIZE];
+
+        // stop reading while the client doesn't take its responses
+        while (conn->output.size() - conn->written < TREE_SERVER_MAX_OUTPUT)
+        {
+            ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+            if (n == 0)
+            {
+                // answer what was sent before closing
+                conn->eof = true;
+                break;
+            }
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return 0;
+            }
+
+            conn->input.append(buffer, n);
+            if (!tree_server_process(trees, *conn)) return 0;
+        }
+    }
+
+    bool pending = false;
+    if (!tree_server_flush(*conn, pending)) return 0;
+    if (conn->eof && !pending) return 0;
+
+    // only wait for writability while responses are queued and for input
+    // while the client can still send and the queue is below the cap
+    uint32_t wanted = pending ? (uint32_t)EPOLLOUT : 0;
+    if (!conn->eof && conn->output.size() < TREE_SERVER_MAX_OUTPUT) wanted |= EPOLLIN;
+    if (wanted == conn->events) return 1;
+    conn->events = wanted;
+
+    epoll_event ev = {};
+    ev.events = wanted;
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+
+    return 1;
+}
+
+int tree_server_run(const TreeServerTrees& trees, const char* address)
+{
+    int listen_fd = tree_server_listen(address);
+    if (listen_fd < 0)
+    {
+        std::cout << "[Error] Failed to listen on " << address << " (" << strerror(errno) << ")\n";
+        return 0;
+    }
+
+    int epoll_fd = epoll_create1(0);
+
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    std::cout << "Listening on " << address << "\n";
+
+    epoll_event events[TREE_SERVER_MAX_EVENTS];
+    for (;;)
+    {
+        int count = epoll_wait(epoll_fd, events, TREE_SERVER_MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto conn = (TreeConnection*)events[i].data.ptr;
+            if (!conn)
+                tree_server_accept(epoll_fd, listen_fd);
+            else if (!tree_server_update(trees, epoll_fd, conn, events[i].events))
+                tree_server_close(epoll_fd, conn);
+        }
+    }
+
+    close(epoll_fd);
+    close(listen_fd);
+    return 0;
+}
+
+#else
+
+int tree_server_run(const TreeServerTrees& trees, const char* address)
+{
+    std::cout << "[Error] Server mode is only supported on linux.\n";
+    return 0;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "tree_handle.h"
+#include "symbol_pool.h"
+
+// ------------------------------------------------------------------------
+// evaluation server
+// ------------------------------------------------------------------------
+// Line based protocol, one request per line:
+//
+//   <tree id> <answer> <answer> ...\n
+//
+// Every request is answered with one line in request order: the name of
+// the reached final node, '-' if the answers don't lead to a final node
+// or '?' if the tree id is unknown, '!' if the request has more than
+// TREE_SERVER_MAX_ANSWERS answers. Clients may pipeline any number of
+// requests, all complete lines of one read are answered with one write.
+// A client that shuts down its sending side still gets all answers before
+// the connection is closed. While more than 1 MB of answers wait for the
+// client, no further requests are read.
+//
+// address is either a path for a unix domain socket or "tcp:<port>" to
+// listen on the loopback interface.
+#define TREE_SERVER_MAX_ANSWERS 64
+
+// trees by the symbol id of their id, so request tokens are looked up
+// without copying them
+struct TreeServerTrees
+{
+    SymbolPool ids;
+    std::vector<TreeHandle*> handles;
+};
+
+// the first tree added under an id is kept
+void tree_server_add(TreeServerTrees& trees, std::string_view id, TreeHandle* handle);
+
+int tree_server_run(const TreeServerTrees& trees, const char* address);
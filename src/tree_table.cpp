@@ -0,0 +1,238 @@
+#include "tree_table.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+#define TREE_TABLE_VERSION 1
+
+// constraint of one variable along the current path
+struct TreeTableCell
+{
+    IntervalSet set;                // numbers, the full range if unconstrained
+    const std::string* option;      // option value, nullptr if unconstrained
+};
+
+struct TreeTableFrame
+{
+    const TreeNode* node;
+    size_t next;                    // next choice to take
+    uint32_t column;
+    TreeTableCell saved;            // cell of the column before entering the node
+
+    IntervalSet taken;              // union of the sets of earlier choices
+    std::unordered_set<std::string_view> options;
+};
+
+struct TreeTableWriter
+{
+    FILE* file;
+    TreeTableFormat format;
+    std::vector<std::string> columns;
+};
+
+static const IntervalSet TREE_TABLE_ANY = { { INT64_MIN, INT64_MAX } };
+
+// variables in order of first appearance, the index keys point into the tree
+static std::vector<std::string> tree_table_columns(const TreeNode& root, std::unordered_map<std::string_view, uint32_t>& index)
+{
+    std::vector<std::string> columns;
+    std::vector<const TreeNode*> stack = { &root };
+    while (!stack.empty())
+    {
+        const TreeNode* node = stack.back();
+        stack.pop_back();
+
+        if ((node->type == NodeType::DECISION || node->type == NodeType::OPTION) && !index.count(node->name))
+        {
+            index.emplace(node->name, (uint32_t)columns.size());
+            columns.push_back(node->name);
+        }
+
+        for (auto it = node->choices.rbegin(); it != node->choices.rend(); ++it)
+            stack.push_back(&*it);
+    }
+    return columns;
+}
+
+// ------------------------------------------------------------------------
+// writing
+// ------------------------------------------------------------------------
+static void tree_table_write_csv_field(FILE* file, std::string_view field)
+{
+    if (field.find_first_of(",\"\n") == std::string_view::npos)
+    {
+        fwrite(field.data(), 1, field.size(), file);
+        return;
+    }
+
+    fputc('"', file);
+    for (char c : field)
+    {
+        if (c == '"') fputc('"', file);
+        fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+static void tree_table_write_u32(FILE* file, uint32_t value)
+{
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+static void tree_table_write_string(FILE* file, std::string_view str)
+{
+    tree_table_write_u32(file, (uint32_t)str.size());
+    fwrite(str.data(), 1, str.size(), file);
+}
+
+static void tree_table_write_header(const TreeTableWriter& writer)
+{
+    if (writer.format == TreeTableFormat::CSV)
+    {
+        for (const auto& column : writer.columns)
+        {
+            tree_table_write_csv_field(writer.file, column);
+            fputc(',', writer.file);
+        }
+        fputs("result\n", writer.file);
+        return;
+    }
+
+    fwrite("DTTB", 1, 4, writer.file);
+    tree_table_write_u32(writer.file, TREE_TABLE_VERSION);
+    tree_table_write_u32(writer.file, (uint32_t)writer.columns.size());
+    for (const auto& column : writer.columns)
+        tree_table_write_string(writer.file, column);
+}
+
+static void tree_table_write_row(const TreeTableWriter& writer, const std::vector<TreeTableCell>& cells, const std::string& result)
+{
+    FILE* file = writer.file;
+    for (const auto& cell : cells)
+    {
+        bool any = !cell.option && cell.set.size() == 1 && cell.set[0].lo == INT64_MIN && cell.set[0].hi == INT64_MAX;
+
+        if (writer.format == TreeTableFormat::CSV)
+        {
+            if (cell.option)    tree_table_write_csv_field(file, *cell.option);
+            else if (!any)      tree_table_write_csv_field(file, decision_expr_format(decision_expr_from_intervals(cell.set)));
+            fputc(',', file);
+            continue;
+        }
+
+        if (any)
+        {
+            fputc(0, file);
+        }
+        else if (cell.option)
+        {
+            fputc(2, file);
+            tree_table_write_string(file, *cell.option);
+        }
+        else
+        {
+            fputc(1, file);
+            tree_table_write_u32(file, (uint32_t)cell.set.size());
+            fwrite(cell.set.data(), sizeof(DecisionInterval), cell.set.size(), file);
+        }
+    }
+
+    if (writer.format == TreeTableFormat::CSV)
+    {
+        tree_table_write_csv_field(file, result);
+        fputc('\n', file);
+    }
+    else
+        tree_table_write_string(file, result);
+}
+
+// ------------------------------------------------------------------------
+// enumeration
+// ------------------------------------------------------------------------
+int tree_table_export(const TreeNode& root, FILE* file, TreeTableFormat format, TreeTableStats* stats)
+{
+    std::unordered_map<std::string_view, uint32_t> index;
+    TreeTableWriter writer = { file, format, tree_table_columns(root, index) };
+    tree_table_write_header(writer);
+
+    size_t rows = 0;
+    size_t pruned = 0;
+
+    std::vector<TreeTableCell> cells(writer.columns.size(), { TREE_TABLE_ANY, nullptr });
+    std::vector<TreeTableFrame> stack;
+
+    auto enter = [&](const TreeNode* node)
+    {
+        if (node->type == NodeType::FINAL)
+        {
+            tree_table_write_row(writer, cells, node->name);
+            rows++;
+            return;
+        }
+
+        // invalid nodes and nodes without a variable end here
+        if (node->type != NodeType::DECISION && node->type != NodeType::OPTION) return;
+
+        uint32_t column = index.at(node->name);
+        stack.push_back({ node, 0, column, cells[column] });
+    };
+
+    enter(&root);
+    while (!stack.empty())
+    {
+        TreeTableFrame& frame = stack.back();
+        if (frame.next >= frame.node->choices.size())
+        {
+            cells[frame.column] = std::move(frame.saved);
+            stack.pop_back();
+            continue;
+        }
+
+        const TreeNode& choice = frame.node->choices[frame.next++];
+        TreeTableCell cell = { frame.saved.set, frame.saved.option };
+
+        if (frame.node->type == NodeType::DECISION)
+        {
+            // like decision_tree_step, a choice without an expression ends the node
+            auto expr = std::get_if<DecisionExpr>(&choice.value);
+            if (!expr)
+            {
+                frame.next = frame.node->choices.size();
+                continue;
+            }
+
+            IntervalSet set = decision_expr_intervals(*expr);
+            cell.set = interval_set_intersect(interval_set_intersect(set, interval_set_complement(frame.taken)), frame.saved.set);
+            frame.taken = interval_set_union(frame.taken, set);
+        }
+        else
+        {
+            auto str = std::get_if<std::string>(&choice.value);
+            if (!str)
+            {
+                frame.next = frame.node->choices.size();
+                continue;
+            }
+
+            // a value seen before already took all its answers
+            if (!frame.options.insert(*str).second || (cell.option && *cell.option != *str))
+                cell.set.clear();
+            cell.option = str;
+        }
+
+        if (cell.set.empty())
+        {
+            pruned++;
+            continue;
+        }
+
+        if (choice.type == NodeType::INVALID) continue;
+
+        // frame may move when entering pushes
+        cells[frame.column] = std::move(cell);
+        enter(&choice);
+    }
+
+    if (stats) *stats = { rows, pruned };
+    return ferror(file) ? 0 : 1;
+}
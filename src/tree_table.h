@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tree.h"
+
+#include <cstdio>
+
+// ------------------------------------------------------------------------
+// decision table export
+// ------------------------------------------------------------------------
+// Enumerates every root to final node path as one row of constraints, one
+// column per variable. A path takes a choice only if no earlier choice of
+// the same node matched, so a numeric cell is the choice's interval set
+// minus those of its earlier siblings, intersected with the constraints
+// already on the path. Paths that can't be taken are pruned. Paths ending
+// in invalid nodes or without a result are left out.
+//
+// The walk is iterative and rows are written as they are found, memory
+// only grows with the depth of the tree.
+//
+// CSV: a header of the variable names and "result", cells in the syntax of
+// the value attribute, empty cells match anything.
+// Binary (host byte order): "DTTB", u32 version, u32 columns, the column
+// names, then per row and column a u8 kind (0 any, 1 intervals, 2 option)
+// followed by u32 count + int64 lo/hi pairs or u32 length + bytes, and
+// the result as u32 length + bytes.
+enum class TreeTableFormat
+{
+    CSV,
+    BINARY
+};
+
+struct TreeTableStats
+{
+    size_t rows;
+    size_t pruned;
+};
+
+int tree_table_export(const TreeNode& root, FILE* file, TreeTableFormat format, TreeTableStats* stats);
@@ -0,0 +1,114 @@
+#include "tree_test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+int tree_test_load(std::vector<TreeTestCase>& cases, const char* filename)
+{
+    std::ifstream file(filename);
+    if (!file)
+    {
+        printf("[Error] Failed to open file (%s).\n", filename);
+        return 0;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number)
+    {
+        // blank lines and comments
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        size_t arrow = line.find("->");
+        if (arrow == std::string::npos)
+        {
+            printf("[warn] Case %s:%d has no expected result.\n", filename, number);
+            return 0;
+        }
+
+        TreeTestCase test = { {}, {}, number };
+
+        std::istringstream answers(line.substr(0, arrow));
+        for (std::string answer; answers >> answer;)
+            test.answers.push_back(answer);
+
+        std::istringstream expected(line.substr(arrow + 2));
+        expected >> test.expected;
+        if (test.expected.empty())
+        {
+            printf("[warn] Case %s:%d has no expected result.\n", filename, number);
+            return 0;
+        }
+        if (test.expected == "-") test.expected.clear();
+
+        cases.push_back(std::move(test));
+    }
+    return 1;
+}
+
+struct TreeTestFailure
+{
+    const TreeTestCase* test;
+    std::string reached;
+};
+
+static void tree_test_range(const TreeWalker* walker, const TreeTestCase* first, const TreeTestCase* last, std::vector<TreeTestFailure>* failures)
+{
+    std::vector<std::string_view> answers;
+    for (const TreeTestCase* test = first; test < last; ++test)
+    {
+        answers.assign(test->answers.begin(), test->answers.end());
+        const TreeNode* node = decision_tree_walk(&walker->root, answers.data(), answers.size());
+
+        // running out of answers before a final node counts as reaching nothing
+        if (node && node->type != NodeType::FINAL) node = nullptr;
+
+        std::string_view reached = node ? std::string_view(node->name) : std::string_view();
+        if (reached != test->expected)
+            failures->push_back({ test, std::string(reached) });
+    }
+}
+
+TreeTestReport tree_test_run(const TreeWalker& walker, const std::vector<TreeTestCase>& cases, size_t threads, size_t max_failures)
+{
+    // every thread gets at least one case
+    threads = std::max<size_t>(1, std::min(threads, cases.size()));
+
+    std::vector<std::vector<TreeTestFailure>> failures(threads);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t chunk = (cases.size() + threads - 1) / threads;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        const TreeTestCase* first = cases.data() + std::min(cases.size(), i * chunk);
+        const TreeTestCase* last = cases.data() + std::min(cases.size(), (i + 1) * chunk);
+        workers.emplace_back(tree_test_range, &walker, first, last, &failures[i]);
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // chunks are in file order, so are their failures
+    size_t failed = 0;
+    for (const auto& list : failures)
+    {
+        for (const auto& failure : list)
+        {
+            if (failed++ >= max_failures) continue;
+
+            const char* reached = failure.reached.empty() ? "-" : failure.reached.c_str();
+            const char* expected = failure.test->expected.empty() ? "-" : failure.test->expected.c_str();
+            printf("[Failed] line %d: reached %s, expected %s.\n", failure.test->line, reached, expected);
+        }
+    }
+
+    if (failed > max_failures)
+        printf("[Failed] ... and %zu more.\n", failed - max_failures);
+
+    return { cases.size() - failed, failed, threads, seconds };
+}
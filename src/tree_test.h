@@ -0,0 +1,35 @@
+#pragma once
+
+#include "tree_walker.h"
+
+// ------------------------------------------------------------------------
+// regression tests
+// ------------------------------------------------------------------------
+// Case files hold one case per line, the answers in order, "->" and the
+// expected result name, or '-' if the answers lead nowhere:
+//
+//   # comment
+//   sunny 10 -> walk
+//   sunny -10 -> -
+//
+// A case passes if walking the answers ends on a final node of that name
+// (or on nothing for '-'). Cases are split over threads.
+struct TreeTestCase
+{
+    std::vector<std::string> answers;
+    std::string expected;       // empty for '-'
+    int line;
+};
+
+struct TreeTestReport
+{
+    size_t passed;
+    size_t failed;
+    size_t threads;
+    double seconds;
+};
+
+int tree_test_load(std::vector<TreeTestCase>& cases, const char* filename);
+
+// prints the failed cases (up to max_failures) ordered by line
+TreeTestReport tree_test_run(const TreeWalker& walker, const std::vector<TreeTestCase>& cases, size_t threads, size_t max_failures);
@@ -0,0 +1,535 @@
+#include "tree_train.h"
+
+#include "symbol_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <iostream>
+#include <thread>
+
+struct TrainColumn
+{
+    std::string name;
+    bool numeric = true;
+
+    // numeric columns
+    std::vector<int64_t> numbers;
+    std::vector<uint8_t> bins;      // bin of every row, bin b holds values <= cuts[b]
+    std::vector<int64_t> cuts;
+
+    // categorical columns
+    std::vector<uint32_t> categories;
+    SymbolPool category_names;
+};
+
+struct TrainData
+{
+    std::vector<TrainColumn> columns;
+    size_t label;
+    size_t rows;
+    size_t classes;
+
+    std::vector<uint32_t> labels;
+    std::vector<uint32_t> order;    // row permutation, every node owns a range
+};
+
+struct TrainNode
+{
+    size_t begin;
+    size_t end;
+    int depth;
+    std::vector<uint64_t> counts;
+
+    // split, no children for leaves
+    size_t column;
+    int64_t threshold;
+    std::vector<uint32_t> children;
+    std::vector<uint32_t> categories;
+};
+
+struct TrainSplit
+{
+    double gain;
+    size_t bin;
+};
+
+// run func(index, worker) for every index in [0, count) on the given number of threads
+template <typename Func>
+static void train_parallel(size_t count, size_t threads, Func func)
+{
+    std::atomic<size_t> next(0);
+    auto work = [&](size_t worker)
+    {
+        for (size_t i = next++; i < count; i = next++)
+            func(i, worker);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < threads && w < count; ++w)
+        workers.emplace_back(work, w);
+
+    work(0);
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// ------------------------------------------------------------------------
+// csv
+// ------------------------------------------------------------------------
+static void train_column_add(TrainColumn& column, std::string_view value)
+{
+    if (column.numeric)
+    {
+        int64_t number = 0;
+        auto end = value.data() + value.size();
+        auto result = std::from_chars(value.data(), end, number);
+        if (result.ec == std::errc() && result.ptr == end && !value.empty())
+        {
+            column.numbers.push_back(number);
+            return;
+        }
+
+        // not an integer column after all
+        column.numeric = false;
+        for (int64_t n : column.numbers)
+            column.categories.push_back(symbol_pool_intern(column.category_names, std::to_string(n)));
+
+        column.numbers = std::vector<int64_t>();
+    }
+
+    column.categories.push_back(symbol_pool_intern(column.category_names, value));
+}
+
+static std::string_view train_next_field(std::string_view& line)
+{
+    size_t comma = line.find(',');
+    std::string_view field = line.substr(0, comma);
+    line = comma == std::string_view::npos ? std::string_view() : line.substr(comma + 1);
+    return field;
+}
+
+static int train_read_csv(TrainData& data, const char* filename, const char* label)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file)
+    {
+        std::cout << "[Error] Failed to open file (" << filename << ").\n";
+        return 0;
+    }
+
+    std::string text;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+    fclose(file);
+
+    std::string_view rest = text;
+    bool header = true;
+    data.rows = 0;
+
+    while (!rest.empty())
+    {
+        size_t newline = rest.find('\n');
+        std::string_view line = rest.substr(0, newline);
+        rest = newline == std::string_view::npos ? std::string_view() : rest.substr(newline + 1);
+
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        if (header)
+        {
+            while (!line.empty())
+                data.columns.push_back({ std::string(train_next_field(line)) });
+            header = false;
+            continue;
+        }
+
+        // check the field count before touching the columns
+        size_t fields = std::count(line.begin(), line.end(), ',') + 1;
+        if (fields != data.columns.size())
+        {
+            std::cout << "[Warn] Skipped row " << data.rows + 1 << " with " << fields << " fields.\n";
+            continue;
+        }
+
+        for (auto& column : data.columns)
+            train_column_add(column, train_next_field(line));
+
+        data.rows++;
+    }
+
+    if (data.columns.empty() || data.rows == 0)
+    {
+        std::cout << "[Error] No data in " << filename << "\n";
+        return 0;
+    }
+
+    data.label = data.columns.size() - 1;
+    if (label)
+    {
+        auto found = std::find_if(data.columns.begin(), data.columns.end(), [&](const TrainColumn& c) { return c.name == label; });
+        if (found == data.columns.end())
+        {
+            std::cout << "[Error] Missing label column " << label << "\n";
+            return 0;
+        }
+        data.label = found - data.columns.begin();
+    }
+
+    // labels are always categories
+    TrainColumn& labels = data.columns[data.label];
+    if (labels.numeric)
+    {
+        labels.numeric = false;
+        for (int64_t n : labels.numbers)
+            labels.categories.push_back(symbol_pool_intern(labels.category_names, std::to_string(n)));
+        labels.numbers = std::vector<int64_t>();
+    }
+
+    data.labels = std::move(labels.categories);
+    data.classes = labels.category_names.strings.size();
+    return 1;
+}
+
+// quantile bins from a sample of the column
+static void train_column_bin(TrainColumn& column, int max_bins)
+{
+    size_t count = column.numbers.size();
+    size_t step = std::max<size_t>(1, count / (1 << 20));
+
+    std::vector<int64_t> sample;
+    for (size_t i = 0; i < count; i += step)
+        sample.push_back(column.numbers[i]);
+
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<int64_t> distinct = sample;
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+    // the values above the last cut get a bin of their own
+    if (distinct.size() <= (size_t)max_bins)
+    {
+        column.cuts = distinct;
+    }
+    else
+    {
+        for (int i = 1; i <= max_bins; ++i)
+            column.cuts.push_back(sample[i * sample.size() / (max_bins + 1)]);
+        column.cuts.erase(std::unique(column.cuts.begin(), column.cuts.end()), column.cuts.end());
+    }
+
+    column.bins.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        column.bins[i] = (uint8_t)(std::lower_bound(column.cuts.begin(), column.cuts.end(), column.numbers[i]) - column.cuts.begin());
+
+    column.numbers = std::vector<int64_t>();
+}
+
+// ------------------------------------------------------------------------
+// split search
+// ------------------------------------------------------------------------
+static double train_sum_squares(const uint64_t* counts, size_t classes)
+{
+    double sum = 0.0;
+    for (size_t c = 0; c < classes; ++c)
+        sum += (double)counts[c] * (double)counts[c];
+    return sum;
+}
+
+// gini gain of the best split of node on column, gain 0 if there is none
+static TrainSplit train_best_split(const TrainData& data, const TrainNode& node, const TrainColumn& column, const TreeTrainOptions& options, std::vector<uint64_t>& hist)
+{
+    const size_t classes = data.classes;
+    const size_t n = node.end - node.begin;
+    const double parent = train_sum_squares(node.counts.data(), classes) / n;
+
+    TrainSplit best = { 0.0, 0 };
+
+    if (column.numeric)
+    {
+        size_t bins = column.cuts.size() + 1;
+        hist.assign(bins * classes, 0);
+        for (size_t i = node.begin; i < node.end; ++i)
+        {
+            uint32_t row = data.order[i];
+            hist[column.bins[row] * classes + data.labels[row]]++;
+        }
+
+        std::vector<uint64_t> left(classes, 0);
+        std::vector<uint64_t> right(classes, 0);
+        size_t left_count = 0;
+        for (size_t b = 0; b + 1 < bins; ++b)
+        {
+            size_t bin_count = 0;
+            for (size_t c = 0; c < classes; ++c)
+            {
+                left[c] += hist[b * classes + c];
+                bin_count += hist[b * classes + c];
+            }
+            left_count += bin_count;
+
+            size_t right_count = n - left_count;
+            if (right_count == 0) break;
+            if (bin_count == 0 || left_count < options.min_samples_leaf || right_count < options.min_samples_leaf) continue;
+
+            for (size_t c = 0; c < classes; ++c)
+                right[c] = node.counts[c] - left[c];
+
+            double score = train_sum_squares(left.data(), classes) / left_count + train_sum_squares(right.data(), classes) / right_count;
+            double gain = (score - parent) / n;
+            if (gain > best.gain) best = { gain, b };
+        }
+        return best;
+    }
+
+    size_t categories = column.category_names.strings.size();
+    hist.assign(categories * classes, 0);
+    for (size_t i = node.begin; i < node.end; ++i)
+    {
+        uint32_t row = data.order[i];
+        hist[column.categories[row] * classes + data.labels[row]]++;
+    }
+
+    // one choice per category present in the node
+    double score = 0.0;
+    size_t present = 0;
+    for (size_t k = 0; k < categories; ++k)
+    {
+        const uint64_t* counts = hist.data() + k * classes;
+
+        uint64_t count = 0;
+        for (size_t c = 0; c < classes; ++c) count += counts[c];
+        if (count == 0) continue;
+        if (count < options.min_samples_leaf) return best;
+
+        score += train_sum_squares(counts, classes) / count;
+        present++;
+    }
+
+    if (present > 1)
+        best.gain = (score - parent) / n;
+
+    return best;
+}
+
+// ------------------------------------------------------------------------
+// growing
+// ------------------------------------------------------------------------
+static TrainNode train_make_child(const TrainData& data, size_t begin, size_t end, int depth)
+{
+    TrainNode child = { begin, end, depth, std::vector<uint64_t>(data.classes, 0) };
+    for (size_t i = begin; i < end; ++i)
+        child.counts[data.labels[data.order[i]]]++;
+    return child;
+}
+
+// partition the rows of a split node, returns the child ranges
+static std::vector<TrainNode> train_partition(TrainData& data, TrainNode& node)
+{
+    const TrainColumn& column = data.columns[node.column];
+    uint32_t* first = data.order.data() + node.begin;
+    uint32_t* last = data.order.data() + node.end;
+
+    std::vector<TrainNode> children;
+    if (column.numeric)
+    {
+        uint8_t bin = (uint8_t)(std::lower_bound(column.cuts.begin(), column.cuts.end(), node.threshold) - column.cuts.begin());
+        uint32_t* mid = std::partition(first, last, [&](uint32_t row) { return column.bins[row] <= bin; });
+
+        size_t split = node.begin + (mid - first);
+        children.push_back(train_make_child(data, node.begin, split, node.depth + 1));
+        children.push_back(train_make_child(data, split, node.end, node.depth + 1));
+        return children;
+    }
+
+    std::stable_sort(first, last, [&](uint32_t a, uint32_t b) { return column.categories[a] < column.categories[b]; });
+
+    size_t begin = node.begin;
+    for (size_t i = node.begin; i <= node.end; ++i)
+    {
+        if (i < node.end && column.categories[data.order[i]] == column.categories[data.order[begin]]) continue;
+
+        node.categories.push_back(column.categories[data.order[begin]]);
+        children.push_back(train_make_child(data, begin, i, node.depth + 1));
+        begin = i;
+    }
+    return children;
+}
+
+static bool train_is_pure(const TrainNode& node)
+{
+    size_t n = node.end - node.begin;
+    for (uint64_t count : node.counts)
+        if (count == n) return true;
+    return false;
+}
+
+static void train_grow(TrainData& data, std::vector<TrainNode>& nodes, const TreeTrainOptions& options, size_t threads)
+{
+    const size_t columns = data.columns.size();
+
+    std::vector<uint32_t> frontier = { 0 };
+    while (!frontier.empty())
+    {
+        std::vector<uint32_t> open;
+        for (uint32_t index : frontier)
+        {
+            const TrainNode& node = nodes[index];
+            if (node.depth < options.max_depth && node.end - node.begin >= 2 * options.min_samples_leaf && !train_is_pure(node))
+                open.push_back(index);
+        }
+
+        // score every (node, column) pair
+        std::vector<TrainSplit> splits(open.size() * columns, { 0.0, 0 });
+        std::vector<std::vector<uint64_t>> hists(threads);
+
+        train_parallel(splits.size(), threads, [&](size_t task, size_t worker)
+        {
+            size_t column = task % columns;
+            if (column == data.label) return;
+
+            splits[task] = train_best_split(data, nodes[open[task / columns]], data.columns[column], options, hists[worker]);
+        });
+
+        // pick the best column per node
+        std::vector<uint32_t> split_nodes;
+        for (size_t i = 0; i < open.size(); ++i)
+        {
+            size_t best = columns;
+            for (size_t c = 0; c < columns; ++c)
+            {
+                const TrainSplit& split = splits[i * columns + c];
+                if (split.gain > options.min_gain && (best == columns || split.gain > splits[i * columns + best].gain))
+                    best = c;
+            }
+            if (best == columns) continue;
+
+            TrainNode& node = nodes[open[i]];
+            node.column = best;
+
+            const TrainColumn& column = data.columns[best];
+            if (column.numeric)
+                node.threshold = column.cuts[splits[i * columns + best].bin];
+
+            split_nodes.push_back(open[i]);
+        }
+
+        // partition the rows of all split nodes, their ranges don't overlap
+        std::vector<std::vector<TrainNode>> children(split_nodes.size());
+        train_parallel(split_nodes.size(), threads, [&](size_t i, size_t)
+        {
+            children[i] = train_partition(data, nodes[split_nodes[i]]);
+        });
+
+        frontier.clear();
+        for (size_t i = 0; i < split_nodes.size(); ++i)
+        {
+            for (auto& child : children[i])
+            {
+                nodes[split_nodes[i]].children.push_back((uint32_t)nodes.size());
+                frontier.push_back((uint32_t)nodes.size());
+                nodes.push_back(std::move(child));
+            }
+        }
+    }
+}
+
+static TreeNode train_make_tree_node(const TrainData& data, const std::vector<TrainNode>& nodes, uint32_t index);
+
+// Choices of a numeric split limited to lo..hi. A child splitting the same
+// column again is merged into the parent, so the question is only asked
+// once and every choice gets its own interval.
+static void train_add_intervals(const TrainData& data, const std::vector<TrainNode>& nodes, uint32_t index, int64_t lo, int64_t hi, TreeNode& tree_node)
+{
+    const TrainNode& node = nodes[index];
+    for (size_t i = 0; i < node.children.size(); ++i)
+    {
+        int64_t child_lo = i == 0 ? lo : std::max(lo, node.threshold == INT64_MAX ? INT64_MAX : node.threshold + 1);
+        int64_t child_hi = i == 0 ? std::min(hi, node.threshold) : hi;
+
+        // the rows never reach an empty interval
+        if (child_lo > child_hi || (i > 0 && node.threshold == INT64_MAX)) continue;
+
+        const TrainNode& child = nodes[node.children[i]];
+        if (!child.children.empty() && child.column == node.column)
+        {
+            train_add_intervals(data, nodes, node.children[i], child_lo, child_hi, tree_node);
+            continue;
+        }
+
+        TreeNode choice = train_make_tree_node(data, nodes, node.children[i]);
+        choice.value = decision_expr_from_intervals({ { child_lo, child_hi } });
+        tree_node.choices.push_back(std::move(choice));
+    }
+}
+
+static TreeNode train_make_tree_node(const TrainData& data, const std::vector<TrainNode>& nodes, uint32_t index)
+{
+    const TrainNode& node = nodes[index];
+    const TrainColumn& labels = data.columns[data.label];
+
+    if (node.children.empty())
+    {
+        size_t best = std::max_element(node.counts.begin(), node.counts.end()) - node.counts.begin();
+        return { NodeType::FINAL, std::string(symbol_pool_get(labels.category_names, (uint32_t)best)) };
+    }
+
+    const TrainColumn& column = data.columns[node.column];
+
+    TreeNode tree_node = { column.numeric ? NodeType::DECISION : NodeType::OPTION, column.name };
+    if (column.numeric)
+    {
+        train_add_intervals(data, nodes, index, INT64_MIN, INT64_MAX, tree_node);
+        return tree_node;
+    }
+
+    for (size_t i = 0; i < node.children.size(); ++i)
+    {
+        TreeNode choice = train_make_tree_node(data, nodes, node.children[i]);
+        choice.value = std::string(symbol_pool_get(column.category_names, node.categories[i]));
+        tree_node.choices.push_back(std::move(choice));
+    }
+    return tree_node;
+}
+
+int tree_train_csv(TreeWalker& walker, const char* filename, const char* label, const TreeTrainOptions& options)
+{
+    TrainData data;
+    if (!train_read_csv(data, filename, label))
+        return 0;
+
+    size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    int max_bins = std::clamp(options.max_bins, 1, 255);
+
+    train_parallel(data.columns.size(), threads, [&](size_t i, size_t)
+    {
+        if (data.columns[i].numeric) train_column_bin(data.columns[i], max_bins);
+    });
+
+    data.order.resize(data.rows);
+    for (size_t i = 0; i < data.rows; ++i)
+        data.order[i] = (uint32_t)i;
+
+    std::vector<TrainNode> nodes;
+    nodes.push_back(train_make_child(data, 0, data.rows, 0));
+
+    train_grow(data, nodes, options, threads);
+
+    if (nodes[0].children.empty())
+    {
+        std::cout << "[Error] Found no split in " << filename << "\n";
+        return 0;
+    }
+
+    walker.root = train_make_tree_node(data, nodes, 0);
+    walker.intro = tree_walker_add_text(walker, std::string("Trained from ") + filename + ".");
+
+    const TrainColumn& labels = data.columns[data.label];
+    for (const auto& name : labels.category_names.strings)
+        tree_walker_set_result(walker, name, name);
+
+    return 1;
+}
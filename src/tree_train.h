@@ -0,0 +1,28 @@
+#pragma once
+
+#include "tree_walker.h"
+
+// ------------------------------------------------------------------------
+// tree training
+// ------------------------------------------------------------------------
+// Learns a CART style tree from a labeled CSV file (header row, comma
+// separated, no quoting). Columns holding only integers become decision
+// nodes split at thresholds, all other columns become option nodes with one
+// choice per value. Repeated splits of a column right below each other are
+// merged into one decision with an interval per choice, so every question
+// is asked once. Leaves are final nodes named by label.
+//
+// Numeric columns are bucketed into at most max_bins quantile bins, split
+// search runs on per node class histograms. The tree grows level by level,
+// every level scores all (node, column) pairs and partitions the rows of
+// all nodes in parallel.
+struct TreeTrainOptions
+{
+    int max_depth = 16;
+    int max_bins = 255;
+    size_t min_samples_leaf = 1;
+    double min_gain = 1e-7;
+    size_t threads = 0;     // 0 uses all hardware threads
+};
+
+int tree_train_csv(TreeWalker& walker, const char* filename, const char* label, const TreeTrainOptions& options);
@@ -1,61 +1,251 @@
 #include "tree_walker.h"
+#include "tree_scan.h"
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <set>
+
+// append str to text, the offsets are 32 bit
+static TreeTextRef tree_walker_append(std::string& text, std::string_view str)
+{
+    if (text.size() + str.size() > UINT32_MAX)
+    {
+        std::cout << "[warn] Text exceeds 4 GB, the rest is left out.\n";
+        return {};
+    }
+
+    TreeTextRef ref = { (uint32_t)text.size(), (uint32_t)str.size() };
+    text.append(str);
+    return ref;
+}
+
+// ------------------------------------------------------------------------
+// text tables
+// ------------------------------------------------------------------------
+static TreeTextTable::const_iterator tree_text_lower_bound(const TreeTextTable& table, uint32_t symbol)
+{
+    return std::lower_bound(table.begin(), table.end(), symbol,
+        [](const TreeTextEntry& entry, uint32_t symbol) { return entry.symbol < symbol; });
+}
+
+const TreeTextRef* tree_text_find(const TreeTextTable& table, uint32_t symbol)
+{
+    auto entry = tree_text_lower_bound(table, symbol);
+    return entry != table.end() && entry->symbol == symbol ? &entry->text : nullptr;
+}
 
-// read the intro text if available
-static void tree_walker_read_intro(TreeWalker& walker, tinyxml2::XMLElement* element)
+void tree_text_set(TreeTextTable& table, uint32_t symbol, TreeTextRef text)
 {
-    auto intro_element = element->FirstChildElement("intro");
-    if (!intro_element) return;
+    // new names mostly come last
+    if (table.empty() || table.back().symbol < symbol)
+    {
+        table.push_back({ symbol, text });
+        return;
+    }
 
-    const char* intro_text = intro_element->GetText();
-    walker.intro = intro_text ? intro_text : "";
+    auto entry = table.begin() + (tree_text_lower_bound(table, symbol) - table.begin());
+    if (entry != table.end() && entry->symbol == symbol)
+        entry->text = text;
+    else
+        table.insert(entry, { symbol, text });
+}
+
+void tree_text_remove(TreeTextTable& table, uint32_t symbol)
+{
+    auto entry = tree_text_lower_bound(table, symbol);
+    if (entry != table.end() && entry->symbol == symbol)
+        table.erase(entry);
+}
+
+// ------------------------------------------------------------------------
+// reading
+// ------------------------------------------------------------------------
+// Both readers below have to agree byte for byte, a lazy walker checks the
+// scanned blob against the one read with the tree. A prompt is the first
+// prompt child of a named decision or option on the way down from the first
+// node, the intro the first intro child of the root element and the results
+// the result children of the root element. The first text of a name wins.
+
+// append to the table unless the name already has a text
+static void tree_walker_add_entry(SymbolPool& symbols, TreeTextTable& table, std::string& text, const char* name, const char* str)
+{
+    if (!name || !str) return;
+
+    uint32_t symbol = symbol_pool_intern(symbols, name);
+    if (!tree_text_find(table, symbol))
+        tree_text_set(table, symbol, tree_walker_append(text, str));
+}
+
+static bool tree_walker_is_node(std::string_view tag)
+{
+    return tag == "decision" || tag == "option";
 }
 
 // recursivly read the prompts for the decisions
-static void tree_walker_read_prompts(TreeWalker& walker, tinyxml2::XMLElement* element)
+void tree_walker_read_prompts(SymbolPool& symbols, TreeTextTable& prompts, std::string& text, tinyxml2::XMLElement* element)
 {
-    const char* name = element->Attribute("name");
     auto prompt_element = element->FirstChildElement("prompt");
-    const char* prompt = prompt_element ? prompt_element->GetText() : nullptr;
+    tree_walker_add_entry(symbols, prompts, text, element->Attribute("name"), prompt_element ? prompt_element->GetText() : nullptr);
 
-    if (name && prompt)
-        walker.prompts.emplace(name, prompt);
+    for (auto child = element->FirstChildElement(); child; child = child->NextSiblingElement())
+    {
+        if (tree_walker_is_node(child->Name()))
+            tree_walker_read_prompts(symbols, prompts, text, child);
+    }
+}
 
-    auto child = element->FirstChildElement();
-    while (child)
+// the text of element and everything below it in document order, prompts
+// are read while on the way down from the first node
+static void tree_walker_read_element(TreeWalker& walker, tinyxml2::XMLElement* element, tinyxml2::XMLElement* first_node, bool prompts)
+{
+    prompts = element == first_node || (prompts && tree_walker_is_node(element->Name()));
+    if (prompts)
     {
-        NodeType type = parse_node_type(child->Name());
+        auto prompt_element = element->FirstChildElement("prompt");
+        tree_walker_add_entry(*walker.symbols, walker.prompts, walker.text, element->Attribute("name"), prompt_element ? prompt_element->GetText() : nullptr);
+    }
+
+    auto root = element->Parent() ? element->Parent()->ToElement() : nullptr;
+    if (root && !root->Parent()->ToElement())
+    {
+        if (element == root->FirstChildElement("intro"))
+        {
+            const char* intro_text = element->GetText();
+            walker.intro = tree_walker_append(walker.text, intro_text ? intro_text : "");
+        }
+        else if (strcmp(element->Name(), "result") == 0)
+            tree_walker_add_entry(*walker.symbols, walker.results, walker.text, element->Attribute("name"), element->GetText());
+    }
 
-        if (type == NodeType::DECISION || type == NodeType::OPTION)
-            tree_walker_read_prompts(walker, child);
+    for (auto child = element->FirstChildElement(); child; child = child->NextSiblingElement())
+        tree_walker_read_element(walker, child, first_node, prompts);
+}
 
-        // next
-        child = child->NextSiblingElement();
+// A text element found by the scanner. Prompts get their slot at the start
+// tag of their node, so the order matches tree_walker_read_element.
+enum class TreeTextKind
+{
+    PROMPT,
+    INTRO,
+    RESULT
+};
+
+struct TreeTextSlot
+{
+    TreeTextKind kind;
+    std::string_view tag;   // the node of a prompt
+    size_t begin;           // the text element, npos until found
+    size_t end;             // npos until closed
+};
+
+struct TreeTextFrame
+{
+    bool prompts;           // on the way down from the first node
+    bool prompted;          // the first prompt child was seen
+    size_t slot;            // of the prompt of this node
+    size_t closes;          // slot that ends with this element
+};
+
+static std::vector<TreeTextSlot> tree_walker_scan_slots(std::string_view file)
+{
+    std::vector<TreeTextSlot> slots;
+    std::vector<TreeTextFrame> stack;
+    bool first_node = false, intro = false, root = false;
+
+    size_t pos = 0;
+    while ((pos = file.find('<', pos)) != std::string_view::npos)
+    {
+        TreeScanTag kind;
+        size_t end = tree_scan_tag(file, pos, kind);
+        if (end == std::string_view::npos) break;
+
+        std::string_view tag = file.substr(pos, end - pos);
+        pos = end;
+
+        if (kind == TreeScanTag::CLOSE)
+        {
+            if (stack.empty()) break;
+            if (stack.back().closes != std::string_view::npos) slots[stack.back().closes].end = end;
+            stack.pop_back();
+            continue;
+        }
+
+        if (kind == TreeScanTag::OTHER) continue;
+
+        // a second root element isn't read by tinyxml2 either
+        if (stack.empty() && root) break;
+        root = true;
+
+        std::string_view name = tree_scan_tag_name(tag);
+        TreeTextFrame* parent = stack.empty() ? nullptr : &stack.back();
+        TreeTextFrame frame = { false, false, std::string_view::npos, std::string_view::npos };
+
+        bool node = tree_walker_is_node(name);
+        frame.prompts = (node && !first_node) || (node && parent && parent->prompts);
+        first_node = first_node || node;
+
+        if (frame.prompts)
+        {
+            frame.slot = slots.size();
+            slots.push_back({ TreeTextKind::PROMPT, tag, std::string_view::npos, std::string_view::npos });
+        }
+
+        if (stack.size() == 1 && ((name == "intro" && !intro) || name == "result"))
+        {
+            intro = intro || name == "intro";
+            frame.closes = slots.size();
+            slots.push_back({ name == "intro" ? TreeTextKind::INTRO : TreeTextKind::RESULT, {}, pos - tag.size(), std::string_view::npos });
+        }
+        else if (parent && parent->prompts && !parent->prompted && name == "prompt")
+        {
+            parent->prompted = true;
+            frame.closes = parent->slot;
+            slots[parent->slot].begin = pos - tag.size();
+        }
+
+        if (kind == TreeScanTag::EMPTY)
+        {
+            if (frame.closes != std::string_view::npos) slots[frame.closes].end = end;
+        }
+        else
+            stack.push_back(frame);
     }
+    return slots;
 }
 
-// read the describtions for the results
-static void tree_walker_read_results(TreeWalker& walker, tinyxml2::XMLElement* element)
+// the blob of a tree file, only parsing the text elements
+static void tree_walker_scan_text(TreeWalker& walker, std::string_view file)
 {
-    auto child = element->FirstChildElement("result");
-    while (child)
+    tinyxml2::XMLDocument doc, node_doc;
+    for (const auto& slot : tree_walker_scan_slots(file))
     {
-        const char* name = child->Attribute("name");
-        const char* text = child->GetText();
+        if (slot.begin == std::string_view::npos || slot.end == std::string_view::npos) continue;
 
-        if (name && text)
-            walker.results.emplace(name, text);
+        if (doc.Parse(file.data() + slot.begin, slot.end - slot.begin) != tinyxml2::XML_SUCCESS || !doc.RootElement())
+            continue;
 
-        // next
-        child = child->NextSiblingElement("result");
+        const char* str = doc.RootElement()->GetText();
+        if (slot.kind == TreeTextKind::INTRO)
+        {
+            walker.intro = tree_walker_append(walker.text, str ? str : "");
+        }
+        else if (slot.kind == TreeTextKind::RESULT)
+        {
+            tree_walker_add_entry(*walker.symbols, walker.results, walker.text, doc.RootElement()->Attribute("name"), str);
+        }
+        else
+        {
+            auto node = tree_scan_parse_tag(node_doc, slot.tag, TreeScanTag::OPEN);
+            if (node) tree_walker_add_entry(*walker.symbols, walker.prompts, walker.text, node->Attribute("name"), str);
+        }
     }
 }
 
 // find the first node of the actual tree (first element with tag 'decision' or 'option')
 static tinyxml2::XMLElement* tree_walker_find_first_node(tinyxml2::XMLElement* element)
 {
-    NodeType type = parse_node_type(element->Name());
-    if (type == NodeType::DECISION || type == NodeType::OPTION) return element;
+    if (tree_walker_is_node(element->Name())) return element;
 
     auto child = element->FirstChildElement();
     while (child)
@@ -70,7 +260,7 @@ static tinyxml2::XMLElement* tree_walker_find_first_node(tinyxml2::XMLElement* e
 }
 
 // load a TreeWalker from file
-int tree_walker_load(TreeWalker& walker, const char* filename)
+int tree_walker_load(TreeWalker& walker, const char* filename, TreeWalkerText text)
 {
     tinyxml2::XMLDocument doc;
     auto result = doc.LoadFile(filename);
@@ -80,7 +270,14 @@ int tree_walker_load(TreeWalker& walker, const char* filename)
         return 0;
     }
 
-    auto first_node = tree_walker_find_first_node(doc.RootElement());
+    return tree_walker_read(walker, doc, filename, text);
+}
+
+// read a TreeWalker from a parsed document, filename is only used for errors
+// and to read lazy text again
+int tree_walker_read(TreeWalker& walker, tinyxml2::XMLDocument& doc, const char* filename, TreeWalkerText text)
+{
+    auto first_node = doc.RootElement() ? tree_walker_find_first_node(doc.RootElement()) : nullptr;
 
     if (!first_node)
     {
@@ -90,10 +287,213 @@ int tree_walker_load(TreeWalker& walker, const char* filename)
 
     walker.root = parse_tree_node(first_node, NodeType::UNKNOWN);
 
-    tree_walker_read_prompts(walker, first_node);
-    tree_walker_read_results(walker, doc.RootElement());
-    tree_walker_read_intro(walker, doc.RootElement());
+    if (text == TreeWalkerText::NONE) return 1;
+
+    if (!walker.symbols) walker.symbols = std::make_shared<SymbolPool>();
+    tree_walker_read_element(walker, doc.RootElement(), first_node, false);
+    walker.text.shrink_to_fit();
+
+    // the references stay, the blob is read again on first use
+    if (text == TreeWalkerText::LAZY)
+    {
+        walker.source = std::make_shared<TreeTextSource>();
+        walker.source->filename = filename;
+        walker.source->size = walker.text.size();
+        walker.source->hash = std::hash<std::string>()(walker.text);
+        walker.source->loaded = false;
+        std::string().swap(walker.text);
+    }
+
+    return 1;
+}
+
+// ------------------------------------------------------------------------
+// text
+// ------------------------------------------------------------------------
+static void tree_walker_load_source(TreeTextSource& source)
+{
+    std::string file;
+    FILE* fp = fopen(source.filename.c_str(), "rb");
+    if (fp)
+    {
+        char buffer[1 << 16];
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0;)
+            file.append(buffer, n);
+        fclose(fp);
+    }
+
+    // names go into a pool of their own, only the blob is kept
+    TreeWalker walker;
+    walker.symbols = std::make_shared<SymbolPool>();
+    tree_walker_scan_text(walker, file);
+
+    if (fp && walker.text.size() == source.size && std::hash<std::string>()(walker.text) == source.hash)
+        source.text = std::move(walker.text);
+    else
+        std::cout << "[warn] Text of " << source.filename << " changed since it was loaded, it's left out.\n";
+
+    source.loaded = true;
+}
+
+std::string_view tree_walker_blob(const TreeWalker& walker)
+{
+    if (!walker.source) return walker.text;
+
+    TreeTextSource& source = *walker.source;
+    std::call_once(source.once, tree_walker_load_source, std::ref(source));
+    return source.text;
+}
+
+std::string_view tree_walker_text(const TreeWalker& walker, TreeTextRef ref)
+{
+    std::string_view blob = tree_walker_blob(walker);
+    if ((uint64_t)ref.offset + ref.length > blob.size()) return {};
+
+    return blob.substr(ref.offset, ref.length);
+}
+
+TreeTextRef tree_walker_add_text(TreeWalker& walker, std::string_view str)
+{
+    if (walker.source)
+    {
+        walker.text = std::string(tree_walker_blob(walker));
+        walker.source.reset();
+    }
+
+    return tree_walker_append(walker.text, str);
+}
+
+static std::string_view tree_walker_find_text(const TreeWalker& walker, const TreeTextTable& table, std::string_view name)
+{
+    const TreeTextRef* ref = walker.symbols ? tree_text_find(table, symbol_pool_find(*walker.symbols, name)) : nullptr;
+    return ref ? tree_walker_text(walker, *ref) : std::string_view();
+}
+
+std::string_view tree_walker_prompt(const TreeWalker& walker, std::string_view name)
+{
+    return tree_walker_find_text(walker, walker.prompts, name);
+}
+
+std::string_view tree_walker_result(const TreeWalker& walker, std::string_view name)
+{
+    return tree_walker_find_text(walker, walker.results, name);
+}
+
+void tree_walker_set_prompt(TreeWalker& walker, std::string_view name, std::string_view str)
+{
+    if (!walker.symbols) walker.symbols = std::make_shared<SymbolPool>();
+    tree_text_set(walker.prompts, symbol_pool_intern(*walker.symbols, name), tree_walker_add_text(walker, str));
+}
+
+void tree_walker_set_result(TreeWalker& walker, std::string_view name, std::string_view str)
+{
+    if (!walker.symbols) walker.symbols = std::make_shared<SymbolPool>();
+    tree_text_set(walker.results, symbol_pool_intern(*walker.symbols, name), tree_walker_add_text(walker, str));
+}
+
+static void tree_walker_rebase_table(TreeTextTable& table, const SymbolPool& from, SymbolPool& to)
+{
+    for (auto& entry : table)
+        entry.symbol = symbol_pool_intern(to, symbol_pool_get(from, entry.symbol));
+
+    std::sort(table.begin(), table.end(), [](const TreeTextEntry& a, const TreeTextEntry& b) { return a.symbol < b.symbol; });
+}
+
+void tree_walker_rebase(TreeWalker& walker, std::shared_ptr<SymbolPool> symbols)
+{
+    if (walker.symbols == symbols) return;
+
+    if (walker.symbols)
+    {
+        tree_walker_rebase_table(walker.prompts, *walker.symbols, *symbols);
+        tree_walker_rebase_table(walker.results, *walker.symbols, *symbols);
+    }
+
+    walker.symbols = std::move(symbols);
+}
+
+static const char* tree_walker_type_name(NodeType type)
+{
+    switch (type)
+    {
+    case NodeType::DECISION: return "decision";
+    case NodeType::OPTION:   return "option";
+    case NodeType::INVALID:  return "invalid";
+    case NodeType::FINAL:    return "final";
+    default:                 return nullptr;
+    }
+}
+
+// recursivly write the nodes, prompts are written once per name
+static void tree_walker_write_node(const TreeWalker& walker, tinyxml2::XMLPrinter& printer, const TreeNode& node, NodeType parent_type, std::set<std::string>& prompted)
+{
+    const char* tag = tree_walker_type_name(node.type);
+    if (!tag) return;
+
+    printer.OpenElement(tag);
+
+    if (parent_type == NodeType::DECISION)
+    {
+        if (auto expr = std::get_if<DecisionExpr>(&node.value))
+            printer.PushAttribute("value", decision_expr_format(*expr).c_str());
+    }
+    else if (parent_type == NodeType::OPTION)
+    {
+        if (auto str = std::get_if<std::string>(&node.value))
+            printer.PushAttribute("value", str->c_str());
+    }
+
+    if (!node.name.empty())
+        printer.PushAttribute("name", node.name.c_str());
+
+    std::string_view prompt = tree_walker_prompt(walker, node.name);
+    if (!prompt.empty() && !node.choices.empty() && prompted.insert(node.name).second)
+    {
+        printer.OpenElement("prompt");
+        printer.PushText(std::string(prompt).c_str());
+        printer.CloseElement();
+    }
+
+    for (const auto& choice : node.choices)
+        tree_walker_write_node(walker, printer, choice, node.type, prompted);
+
+    printer.CloseElement();
+}
+
+// save a TreeWalker in the format read by tree_walker_load
+int tree_walker_save(const TreeWalker& walker, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        std::cout << "[Error] Failed to open file (" << filename << ") for writing.\n";
+        return 0;
+    }
+
+    tinyxml2::XMLPrinter printer(file);
+    printer.OpenElement("decisiontree");
+
+    std::string intro(tree_walker_text(walker, walker.intro));
+    if (!intro.empty())
+    {
+        printer.OpenElement("intro");
+        printer.PushText(intro.c_str());
+        printer.CloseElement();
+    }
+
+    std::set<std::string> prompted;
+    tree_walker_write_node(walker, printer, walker.root, NodeType::UNKNOWN, prompted);
+
+    for (const auto& result : walker.results)
+    {
+        printer.OpenElement("result");
+        printer.PushAttribute("name", std::string(symbol_pool_get(*walker.symbols, result.symbol)).c_str());
+        printer.PushText(std::string(tree_walker_text(walker, result.text)).c_str());
+        printer.CloseElement();
+    }
 
+    printer.CloseElement();
+    fclose(file);
     return 1;
 }
 
@@ -106,8 +506,8 @@ std::string tree_walker_run(const TreeWalker& walker)
         // check if done
         if (node->type == NodeType::FINAL) break;
 
-        auto prompt = walker.prompts.find(node->name);
-        std::cout << (prompt != walker.prompts.end() ? prompt->second : node->name) << "\n";
+        std::string_view prompt = tree_walker_prompt(walker, node->name);
+        std::cout << (!prompt.empty() ? prompt : node->name) << "\n";
 
         std::string answer = "";
         std::cin >> answer;
@@ -119,7 +519,7 @@ std::string tree_walker_run(const TreeWalker& walker)
         else if (node->type == NodeType::DECISION)
         {
             char* end;
-            int val = strtol(answer.c_str(), &end, 0);
+            int64_t val = strtoll(answer.c_str(), &end, 0);
             if (end != &answer[0] + answer.size())
                 std::cout << "Answer has to be a number.\n";
             else
@@ -137,7 +537,7 @@ std::string tree_walker_run(const TreeWalker& walker)
 void tree_walker_show_intro(const TreeWalker& walker)
 {
     std::cout << "===============================================\n";
-    std::cout << "Decision Tree:\n" << walker.intro << "\n";
+    std::cout << "Decision Tree:\n" << tree_walker_text(walker, walker.intro) << "\n";
     std::cout << "===============================================\n\n";
 }
 
@@ -150,9 +550,9 @@ void tree_walker_show_result(const TreeWalker& walker, const std::string& name)
     }
     else
     {
-        auto result = walker.results.find(name);
-        if (result != walker.results.end())
-            std::cout << "Result:\n" << result->second << "\n";
+        const TreeTextRef* result = walker.symbols ? tree_text_find(walker.results, symbol_pool_find(*walker.symbols, name)) : nullptr;
+        if (result)
+            std::cout << "Result:\n" << tree_walker_text(walker, *result) << "\n";
         else
             std::cout << "Unkown result.\n";
     }
@@ -1,18 +1,103 @@
 #pragma once
 
 #include "tree.h"
+#include "symbol_pool.h"
 
-#include <map>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// ------------------------------------------------------------------------
+// text
+// ------------------------------------------------------------------------
+// The intro, prompts and results are only shown to people, so they're kept
+// out of the tree in one blob and referenced by offset and length. A walker
+// can skip reading them (NONE), for batch evaluation, or drop the blob after
+// loading and read it from the file again the first time it's needed (LAZY).
+// Reading it again only scans the file for the text elements and parses
+// those. A lazy walker remembers the size and hash of the blob and leaves
+// the text empty if the file changed in between.
+//
+// The blob holds the texts in document order: the prompt of a node comes at
+// its start tag, the intro and results at theirs. Prompts and results are
+// found by the symbol id of the node name, in tables sorted by id.
+enum class TreeWalkerText
+{
+    ALL,
+    LAZY,
+    NONE
+};
+
+struct TreeTextRef
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct TreeTextEntry
+{
+    uint32_t symbol;
+    TreeTextRef text;
+};
+
+typedef std::vector<TreeTextEntry> TreeTextTable;
+
+// null if the symbol has no text
+const TreeTextRef* tree_text_find(const TreeTextTable& table, uint32_t symbol);
+void tree_text_set(TreeTextTable& table, uint32_t symbol, TreeTextRef text);
+void tree_text_remove(TreeTextTable& table, uint32_t symbol);
+
+// shared by copies of a lazy walker, the blob is written once
+struct TreeTextSource
+{
+    std::string filename;
+    size_t size;
+    size_t hash;
+
+    std::once_flag once;
+    std::atomic<bool> loaded;
+    std::string text;
+};
 
 struct TreeWalker
 {
     TreeNode root;
-    std::string intro;
-    std::map<std::string, std::string> prompts;
-    std::map<std::string, std::string> results;
+
+    // names of the prompts and results, can be shared with other walkers
+    std::shared_ptr<SymbolPool> symbols;
+
+    TreeTextRef intro = {};
+    TreeTextTable prompts;
+    TreeTextTable results;
+
+    std::string text;
+    std::shared_ptr<TreeTextSource> source; // set while the text is lazy
 };
 
-int tree_walker_load(TreeWalker& walker, const char* filename);
+int tree_walker_load(TreeWalker& walker, const char* filename, TreeWalkerText text = TreeWalkerText::ALL);
+int tree_walker_read(TreeWalker& walker, tinyxml2::XMLDocument& doc, const char* filename, TreeWalkerText text = TreeWalkerText::ALL);
+
+// the prompts of a decision or option element and everything below it, the first one of a name wins
+void tree_walker_read_prompts(SymbolPool& symbols, TreeTextTable& prompts, std::string& text, tinyxml2::XMLElement* element);
+int tree_walker_save(const TreeWalker& walker, const char* filename);
+
+// append to the blob, a lazy walker reads its text first
+TreeTextRef tree_walker_add_text(TreeWalker& walker, std::string_view str);
+
+// the whole blob and a part of it, loading lazy text on first use
+std::string_view tree_walker_blob(const TreeWalker& walker);
+std::string_view tree_walker_text(const TreeWalker& walker, TreeTextRef ref);
+
+// the text of a node name, empty if it has none
+std::string_view tree_walker_prompt(const TreeWalker& walker, std::string_view name);
+std::string_view tree_walker_result(const TreeWalker& walker, std::string_view name);
+
+// add or replace the text of a node name
+void tree_walker_set_prompt(TreeWalker& walker, std::string_view name, std::string_view str);
+void tree_walker_set_result(TreeWalker& walker, std::string_view name, std::string_view str);
+
+// move the names of the prompts and results into another pool
+void tree_walker_rebase(TreeWalker& walker, std::shared_ptr<SymbolPool> symbols);
 
 std::string tree_walker_run(const TreeWalker& walker);
 